@@ -8,10 +8,14 @@
  *
  * This problem uses a Range policy for all 3 instances, and the kernel
  * is the same for all 3 instances. However, there are three Engine instances
- * to choose between: Serial, Static OpenMP and Dynamic OpenMP.
+ * to choose between: Serial, Static OpenMP and Dynamic OpenMP. The fourth
+ * instance is explicitly vectorized with Kokkos SIMD, with a tuned width:
+ * the two boundary cells are peeled off, so the vector loop has no
+ * branches.
  *
  */
 #include <tuning_playground.hpp>
+#include <simd_stencil.hpp>
 
 #include <chrono>
 #include <cmath> // cbrt
@@ -36,9 +40,16 @@ int main(int argc, char *argv[]) {
                 stencil(x) = (stencil(x-1) + stencil(x) + stencil(x+1)) / 3.0;
             }
         };
+        /* The interior update, for the SIMD variant */
+        const auto interior = KOKKOS_LAMBDA(const auto& at) {
+            return (at(-1) + at(0) + at(1)) / 3.0;
+        };
+        fastest_of_tuner choose_one("choose_one", 4);
+        simd_width_tuner simd("1d_annealing");
         Kokkos::Profiling::ScopedRegion region("1d_annealing search loop");
-        for (int i = 0 ; i < 50 ; i++) {
-            fastest_of( "choose_one", 3, [&]() {
+        Impl::benchmark bench("1d_annealing");
+        bench.run(50, [&](const int) {
+            fastest_of(choose_one, [&]() {
                 //std::cout << i << " Doing Serial stencil..." << std::endl;
                 Kokkos::parallel_for("serial heat_transfer",
                     Kokkos::RangePolicy<Kokkos::Serial>(0,length),
@@ -53,9 +64,16 @@ int main(int argc, char *argv[]) {
                 Kokkos::parallel_for("openmp static heat_transfer",
                     Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Static>, Kokkos::OpenMP>(0,length),
                     kernel);
+                }, [&]() {
+                stencil(min_index) = (stencil(min_index) + stencil(min_index+1)) / 2.0;
+                simd([&](auto abi) {
+                    simd_sweep<decltype(abi)>("simd heat_transfer", stencil, stencil,
+                        min_index + 1, max_index, interior);
+                });
+                stencil(max_index) = (stencil(max_index-1) + stencil(max_index)) / 2.0;
                 }
             );
-        }
+        });
     }
     Kokkos::finalize();
 }
@@ -6,12 +6,27 @@
  *
  * Kokkos is executing a simple 1d stencil annealing (heat transfer) problem.
  *
- * This problem uses a Range policy for all 3 instances, and the kernel
+ * This problem uses a Range policy for 3 instances, and the kernel
  * is the same for all 3 instances. However, there are three Engine instances
- * to choose between: Serial, Static OpenMP and Dynamic OpenMP.
+ * to choose between: Serial, Static OpenMP and Dynamic OpenMP. The fourth
+ * instance is temporally blocked: it advances cache-sized tiles several
+ * timesteps at a time, with a tuned time-block depth and tile size. The
+ * fifth is explicitly vectorized with Kokkos SIMD, with a tuned width.
+ *
+ * The stencil is run on a small and a large array, and the array size is
+ * passed to the tuner as a feature: Serial tends to win on the small
+ * array, OpenMP on the large one.
+ *
+ * The arrays are first touched in parallel, with the static schedule the
+ * kernels use, and the NUMA placement of the large ones (first touch,
+ * interleaved or socket local) is tuned too, in a nested context.
  *
  */
 #include <tuning_playground.hpp>
+#include <temporal_blocking.hpp>
+#include <simd_stencil.hpp>
+#include <numa_placement.hpp>
+#include <random_data.hpp>
 
 #include <chrono>
 #include <cmath> // cbrt
@@ -19,67 +34,155 @@
 #include <iostream>
 #include <random>
 #include <tuple>
+#include <utility>
 
-constexpr int length{32768}; // array length
+constexpr int small_length{1024}; // array lengths
+constexpr int large_length{1048576};
 constexpr int lowerBound{100};
 constexpr int upperBound{999};
+using view_type = Kokkos::View<double *, Kokkos::HostSpace>;
 
-// helper function for matrix init
-void initArray(Kokkos::View<double *, Kokkos::HostSpace>& ar, size_t d1) {
-    for(size_t i=0; i<d1; i++){
-        ar(i)=(rand() % (upperBound - lowerBound + 1)) + lowerBound;
+/* Simple 1d, 3-point stencil update - use the average of the left, right
+ * and current cells, for temporal_steps timesteps with the given policy.
+ * A function template rather than a generic lambda, because CUDA can't
+ * define the device lambda inside a generic one. */
+template<typename Policy>
+void sweeps(const std::string& name, const Policy& policy, view_type& source, view_type& dest) {
+    for (int step = 0 ; step < temporal_steps ; step++) {
+        const view_type from = source;
+        const view_type to = dest;
+        Kokkos::parallel_for(name, policy, KOKKOS_LAMBDA(const int x) {
+            to(x) = (from(x-1) + from(x) + from(x+1)) / 3.0;
+        });
+        std::swap(source, dest);
     }
 }
 
+/* Advance the solution temporal_steps timesteps, leaving it in source.
+ * The problem size is passed to the tuner as a feature, so the choice of
+ * engine is learned separately for small and large arrays. The blocking
+ * and SIMD width tuners have no such input, so each size has its own. */
+void stencil_steps(fastest_of_tuner& choose_one, temporal_blocking& blocked,
+                   simd_width_tuner& simd, view_type& source, view_type& dest) {
+    /* To keep the kernel simple, we don't update first or last cells */
+    int min_index = 1;
+    int max_index = source.extent(0) - 1;
+    /* The same update, for the temporally blocked and SIMD variants */
+    const auto stencil = KOKKOS_LAMBDA(const auto& at) {
+        return (at(-1) + at(0) + at(1)) / 3.0;
+    };
+    fastest_of(choose_one, features_of(source), [&]() {
+        /* Option 1: serial host space */
+        sweeps("serial heat_transfer",
+            Kokkos::RangePolicy<Kokkos::Serial>(min_index,max_index), source, dest);
+        }, [&]() {
+        /* Option 2: dynamic schedule OpenMP host space */
+        sweeps("openmp dynamic heat_transfer",
+            Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Dynamic>, Kokkos::OpenMP>(min_index,max_index), source, dest);
+        }, [&]() {
+        /* Option 3: static schedule OpenMP host space */
+        sweeps("openmp static heat_transfer",
+            Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Static>, Kokkos::OpenMP>(min_index,max_index), source, dest);
+        }, [&]() {
+        /* Option 4: temporally blocked tiles, several timesteps per tile */
+        blocked(source, dest, stencil);
+        }, [&]() {
+        /* Option 5: explicit SIMD, with a tuned vector width */
+        simd([&](auto abi) {
+            for (int step = 0 ; step < temporal_steps ; step++) {
+                simd_sweep<decltype(abi)>("simd heat_transfer", source, dest,
+                    min_index, max_index, stencil);
+                std::swap(source, dest);
+            }
+        });
+        }
+    );
+}
+
+/* The L2 norm of the change made by the last steps. The serial and the
+ * parallel reduction are raced under one label, and the winner's result
+ * is handed back. */
+double change_norm(fastest_of_tuner& norm_of, const view_type& before, const view_type& after) {
+    const auto kernel = KOKKOS_LAMBDA(const int x, double& sum) {
+        const double change = after(x) - before(x);
+        sum += change * change;
+    };
+    const int extent = before.extent(0);
+    return std::sqrt(fastest_of(norm_of, features_of(before), [&]() {
+        double sum{0.0};
+        Kokkos::parallel_reduce("serial change norm",
+            Kokkos::RangePolicy<Kokkos::Serial>(0, extent), kernel, sum);
+        return sum;
+        }, [&]() {
+        double sum{0.0};
+        Kokkos::parallel_reduce("openmp change norm",
+            Kokkos::RangePolicy<Kokkos::OpenMP>(0, extent), kernel, sum);
+        return sum;
+        }
+    ));
+}
+
 int main(int argc, char *argv[]) {
     Kokkos::initialize(argc, argv);
     {
         Kokkos::print_configuration(std::cout, false);
-        /* To keep the kernel simple, we don't update first or last cells */
-        int min_index = 1;
-        int max_index = length - 1;
-        /* Create initial view */
-        Kokkos::View<double *, Kokkos::HostSpace> left("left stencil", length);
-        /* Initialize the view */
-        initArray(left, length);
-        /* Create a destination view */
-        Kokkos::View<double *, Kokkos::HostSpace> right("right stencil", length);
-        /* Copy the initial view */
-        Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, right, left);
-        /* Create two view references, a source and a destination */
-        auto& source = left;
-        auto& dest = right;
-        /* Simple 1d, 3-point stencil update - use the average of the left, right and current cells */
-        const auto kernel = KOKKOS_LAMBDA(const int x) {
-            dest(x) = (source(x-1) + source(x) + source(x+1)) / 3.0;
-        };
+        /* Create initial views, one small and one large */
+        view_type small_left(Kokkos::view_alloc(Kokkos::WithoutInitializing, "small left stencil"), small_length);
+        first_touch(small_left);
+        view_type large_left(Kokkos::view_alloc(Kokkos::WithoutInitializing, "large left stencil"), large_length);
+        first_touch(large_left);
+        /* Initialize the views */
+        fill_uniform(small_left, lowerBound, upperBound);
+        fill_uniform(large_left, lowerBound, upperBound);
+        /* Create destination views */
+        view_type small_right(Kokkos::view_alloc(Kokkos::WithoutInitializing, "small right stencil"), small_length);
+        first_touch(small_right);
+        view_type large_right(Kokkos::view_alloc(Kokkos::WithoutInitializing, "large right stencil"), large_length);
+        first_touch(large_right);
+        /* Copy the initial views */
+        Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, small_right, small_left);
+        Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, large_right, large_left);
+        /* Create view references, a source and a destination for each size */
+        auto& small_source = small_left;
+        auto& small_dest = small_right;
+        auto& large_source = large_left;
+        auto& large_dest = large_right;
+        /* Copies of the solutions, to see how much the last steps changed them */
+        view_type small_previous(Kokkos::view_alloc(Kokkos::WithoutInitializing, "small previous stencil"), small_length);
+        first_touch(small_previous);
+        view_type large_previous(Kokkos::view_alloc(Kokkos::WithoutInitializing, "large previous stencil"), large_length);
+        first_touch(large_previous);
+        fastest_of_tuner choose_one("choose_one", 5);
+        temporal_blocking small_blocked("1d_stencil_small", 1, {256, 1024});
+        temporal_blocking large_blocked("1d_stencil_large", 1, {1024, 4096, 16384, 65536});
+        simd_width_tuner small_simd("1d_stencil_small");
+        simd_width_tuner large_simd("1d_stencil_large");
+        fastest_of_tuner norm_of("change_norm", 2);
+        numa_placement_tuner large_placement("1d_stencil_large");
+        large_placement.track(large_left);
+        large_placement.track(large_right);
         Kokkos::Profiling::ScopedRegion region("1d_stencil search loop");
         /* We iterate so that we have enough samples to explore the search space.
          * In a real application, this kernel would get called multiple times over
          * the course of a simulation, and would eventually(?) converge. */
-        for (int i = 0 ; i < Impl::max_iterations ; i++) {
-            fastest_of( "choose_one", 3, [&]() {
-                /* Option 1: serial host space */
-                Kokkos::parallel_for("serial heat_transfer",
-                    Kokkos::RangePolicy<Kokkos::Serial>(min_index,max_index),
-                    kernel);
-                }, [&]() {
-                /* Option 2: dynamic schedule OpenMP host space */
-                Kokkos::parallel_for("openmp dynamic heat_transfer",
-                    Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Dynamic>, Kokkos::OpenMP>(min_index,max_index),
-                    kernel);
-                }, [&]() {
-                /* Option 3: static schedule OpenMP host space */
-                Kokkos::parallel_for("openmp static heat_transfer",
-                    Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Static>, Kokkos::OpenMP>(min_index,max_index),
-                    kernel);
-                }
-            );
-            /* Swap the views */
-            auto& tmp = source;
-            source = dest;
-            dest = tmp;
-        }
+        Impl::benchmark bench("1d_stencil");
+        bench.run(Impl::max_iterations, [&](const int i) {
+            Kokkos::deep_copy(small_previous, small_source);
+            Kokkos::deep_copy(large_previous, large_source);
+            stencil_steps(choose_one, small_blocked, small_simd, small_source, small_dest);
+            large_placement([&]() {
+                stencil_steps(choose_one, large_blocked, large_simd, large_source, large_dest);
+            });
+            /* Check how fast the solution is changing every iteration, so the
+             * norm's race gets the calls to settle, and report it now and then */
+            const double small_change = change_norm(norm_of, small_previous, small_source);
+            const double large_change = change_norm(norm_of, large_previous, large_source);
+            if (i % 100 == 0) {
+                std::cout << "Iteration " << i << ", change norm: "
+                          << small_change << " (small), " << large_change << " (large)"
+                          << std::endl;
+            }
+        });
     }
     Kokkos::finalize();
 }
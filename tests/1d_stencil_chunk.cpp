@@ -12,6 +12,9 @@
  *
  */
 #include <tuning_playground.hpp>
+#include <search_space.hpp>
+#include <numa_placement.hpp>
+#include <random_data.hpp>
 
 #include <chrono>
 #include <cmath> // cbrt
@@ -28,60 +31,6 @@ static const std::string scheduleNames[] = {"static", "dynamic"};
 namespace KTE = Kokkos::Tools::Experimental;
 namespace KE = Kokkos::Experimental;
 
-// helper function for matrix init
-void initArray(Kokkos::View<double *, Kokkos::HostSpace>& ar, size_t d1) {
-    for(size_t i=0; i<d1; i++){
-        ar(i)=(rand() % (upperBound - lowerBound + 1)) + lowerBound;
-    }
-}
-
-// Helper function to generate tile sizes
-std::vector<int64_t> factorsOf(const int &size){
-    std::vector<int64_t> factors;
-    for(int i=1; i<size; i++){
-        if(size % i == 0){
-            factors.push_back(i);
-        }
-    }
-    return factors;
-}
-
-// Helper function to generate thread counts
-std::vector<int64_t> makeRange(const int &size){
-    std::vector<int64_t> range;
-    for(int i=2; i<=size; i+=2){
-        range.push_back(i);
-    }
-    return range;
-}
-
-// helper function for human output
-void reportOptions(std::vector<int64_t>& candidates,
-    std::string name, size_t size) {
-    std::cout<<"Chunk size options for " << name << "="<<size<<std::endl;
-    for(auto &i : candidates){ std::cout<<i<<", "; }
-    std::cout<<std::endl;
-}
-
-// helper function for declaring output tiling variables
-size_t declareOutputTileSize(std::string name, std::string varname, size_t limit) {
-    size_t out_value_id;
-    // create a vector of potential values
-    std::vector<int64_t> candidates = factorsOf(limit);
-    reportOptions(candidates, name, limit);
-    // create our variable object
-    KTE::VariableInfo out_info;
-    // set the variable details
-    out_info.type = KTE::ValueType::kokkos_value_int64;
-    out_info.category = KTE::StatisticalCategory::kokkos_value_categorical;
-    out_info.valueQuantity = KTE::CandidateValueType::kokkos_value_set;
-    out_info.candidates = KTE::make_candidate_set(candidates.size(),candidates.data());
-    // declare the variable
-    out_value_id = KTE::declare_output_type(varname,out_info);
-    // return the id
-    return out_value_id;
-}
-
 // helper function for declaring input size variables
 size_t declareInputViewSize(std::string varname, int64_t size) {
     size_t in_value_id;
@@ -117,24 +66,6 @@ size_t declareOutputSchedules(std::string varname) {
     return schedule_out_value_id;
 }
 
-// helper function for declaring output tread count variable
-size_t declareOutputThreadCount(std::string varname, size_t limit) {
-    size_t out_value_id;
-    // create a vector of potential values
-    std::vector<int64_t> candidates = makeRange(limit);
-    // create our variable object
-    KTE::VariableInfo out_info;
-    // set the variable details
-    out_info.type = KTE::ValueType::kokkos_value_int64;
-    out_info.category = KTE::StatisticalCategory::kokkos_value_categorical;
-    out_info.valueQuantity = KTE::CandidateValueType::kokkos_value_set;
-    out_info.candidates = KTE::make_candidate_set(candidates.size(),candidates.data());
-    // declare the variable
-    out_value_id = KTE::declare_output_type(varname,out_info);
-    // return the id
-    return out_value_id;
-}
-
 int main(int argc, char *argv[]) {
     // surely there is a way to get this from Kokkos?
     bool tuning = false;
@@ -153,11 +84,13 @@ int main(int argc, char *argv[]) {
         int min_index = 1;
         int max_index = length - 1;
         /* Create initial view */
-        Kokkos::View<double *, Kokkos::HostSpace> left("left stencil", length);
+        Kokkos::View<double *, Kokkos::HostSpace> left(Kokkos::view_alloc(Kokkos::WithoutInitializing, "left stencil"), length);
+        first_touch(left);
         /* Initialize the view */
-        initArray(left, length);
+        fill_uniform(left, lowerBound, upperBound);
         /* Create a destination view */
-        Kokkos::View<double *, Kokkos::HostSpace> right("right stencil", length);
+        Kokkos::View<double *, Kokkos::HostSpace> right(Kokkos::view_alloc(Kokkos::WithoutInitializing, "right stencil"), length);
+        first_touch(right);
         /* Copy the initial view */
         Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, right, left);
         /* Create two view references, a source and a destination */
@@ -180,42 +113,60 @@ int main(int argc, char *argv[]) {
             KTE::make_variable_value(id[1], "parallel_for"),
             KTE::make_variable_value(id[2], int64_t(length))
         };
-        // Declare the ouptut variables and store the variable IDs
-        size_t out_value_id[3];
-        out_value_id[0] = declareOutputTileSize("length", "chunk_out", length);
-        out_value_id[1] = declareOutputSchedules("schedule_out");
         int64_t max_threads = std::min(std::thread::hardware_concurrency(),
                 (unsigned int)(Kokkos::OpenMP::concurrency()));
-        out_value_id[2] = declareOutputThreadCount("thread_count", max_threads);
+        /* The chunk size and thread count are searched coarse-to-fine: a
+         * log-spaced grid first, then finer values around the best one. */
+        multiresolution_variable chunk_out("chunk_out", divisorsOf(length));
+        chunk_out.set_default(length/max_threads);
+        multiresolution_variable thread_count("thread_count", threadCountsUpTo(max_threads));
+        thread_count.set_default(max_threads);
+        // each refinement level of the two is a context of its own
+        input_vector.push_back(chunk_out.level_input());
+        input_vector.push_back(thread_count.level_input());
+        // Declare the ouptut variables and store the variable IDs
+        size_t schedule_out = declareOutputSchedules("schedule_out");
         //The second argument to make_varaible_value is a default value
         std::vector<KTE::VariableValue> answer_vector{
-            KTE::make_variable_value(out_value_id[0], int64_t(length/max_threads)),
-            KTE::make_variable_value(out_value_id[1], int64_t(StaticSchedule)),
-            KTE::make_variable_value(out_value_id[2], int64_t(max_threads))
+            chunk_out.answer(),
+            KTE::make_variable_value(schedule_out, int64_t(StaticSchedule)),
+            thread_count.answer()
         };
 
-
+        // latches the tuning decision once it has converged
+        Impl::tuning_latch latch;
         Kokkos::Profiling::ScopedRegion region("1d_stencil_chunk search loop");
 
         /* We iterate so that we have enough samples to explore the search space.
          * In a real application, this kernel would get called multiple times over
          * the course of a simulation, and would eventually(?) converge. */
-        for (int i = 0 ; i < Impl::max_iterations ; i++) {
-            // request a context id
-            size_t context = KTE::get_new_context_id();
-            // start the context
-            KTE::begin_context(context);
-            // set the input values for the context
-            KTE::set_input_values(context, input_vector.size(), input_vector.data());
-            // request new output values for the context
-            KTE::request_output_values(context, answer_vector.size(), answer_vector.data());
+        Impl::benchmark bench("1d_stencil_chunk");
+        bench.run(Impl::max_iterations, [&](const int) {
+            // skip the tuning API if the latched answer is to be reused
+            Impl::tuning_scope scope(latch);
+            if (!scope.latched()) {
+                // the input values for the context, with the current levels
+                input_vector[3] = chunk_out.level_input();
+                input_vector[4] = thread_count.level_input();
+                // open the context and request new output values, at the current resolution
+                answer_vector[0] = chunk_out.answer();
+                answer_vector[2] = thread_count.answer();
+                scope.request(answer_vector.data(), answer_vector.size(),
+                    input_vector.data(), input_vector.size());
+                chunk_out.observe(answer_vector[0]);
+                thread_count.observe(answer_vector[2]);
+            }
             // get the chunk size
             Kokkos::ChunkSize chunk{static_cast<int>(answer_vector[0].value.int_value)};
             // get our schedule and thread count
             int scheduleType = answer_vector[1].value.int_value;
             // there's probably a better way to set the thread count?
             int num_threads = answer_vector[2].value.int_value;
-            int leftover_threads = max_threads - num_threads;
+            if (tuning) {
+                bench.configuration("chunk=" + std::to_string(chunk.value) +
+                    ",schedule=" + scheduleNames[scheduleType] +
+                    ",threads=" + std::to_string(num_threads));
+            }
 
             // no tuning?
             if (!tuning) {
@@ -228,12 +179,11 @@ int main(int argc, char *argv[]) {
                         Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Static>, Kokkos::OpenMP>(
                             min_index, max_index, chunk), kernel);
                 } else {
-                    // partition the space so we can tune the number of threads
-                    auto instances = KE::partition_space(Kokkos::OpenMP(),
-                        num_threads, leftover_threads);
+                    // a pooled partition, so we can tune the number of threads
+                    const auto& instance = Impl::openmp_instances().with_threads(num_threads);
                     Kokkos::parallel_for("openmp dynamic heat_transfer",
                         Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Static>, Kokkos::OpenMP>(
-                            instances[0], min_index, max_index, chunk), kernel);
+                            instance, min_index, max_index, chunk), kernel);
                 }
             } else { // Dynamic schedule
                 if (num_threads == max_threads) {
@@ -241,22 +191,21 @@ int main(int argc, char *argv[]) {
                         Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Dynamic>, Kokkos::OpenMP>(
                             min_index, max_index, chunk), kernel);
                 } else {
-                    // partition the space so we can tune the number of threads
-                    auto instances = KE::partition_space(Kokkos::OpenMP(),
-                        num_threads, leftover_threads);
+                    // a pooled partition, so we can tune the number of threads
+                    const auto& instance = Impl::openmp_instances().with_threads(num_threads);
                     Kokkos::parallel_for("openmp dynamic heat_transfer",
                         Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Dynamic>, Kokkos::OpenMP>(
-                            instances[0], min_index, max_index, chunk), kernel);
+                            instance, min_index, max_index, chunk), kernel);
                 }
             }
             // end the context
-            KTE::end_context(context);
+            scope.close();
 
             /* Swap the views */
             auto& tmp = source;
             source = dest;
             dest = tmp;
-        }
+        });
     }
     Kokkos::finalize();
 }
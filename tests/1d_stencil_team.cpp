@@ -1,18 +1,28 @@
 /**
- * 1D_stencil
+ * 1D_stencil_team
  *
  * Complexity: medium
  * Tuning problem:
  *
  * Kokkos is executing a simple 1d stencil annealing (heat transfer) problem.
  *
- * This problem uses a Team policy for two instances, and the kernel
- * is the same for both instances. However, there are two Engine instances
- * to choose between: Static OpenMP and Dynamic OpenMP. This example will
- * tune the thread count and chunk size (vector length) too.
+ * This problem uses a hierarchical Team policy: the array is split into a
+ * league of tiles, each tile and its two halo cells are staged in team
+ * scratch memory, and the team threads and their vector lanes update the
+ * tile from there. APEX will tune the tile size, team size, vector length
+ * and scratch level as one constrained space, and the OpenMP schedule.
+ * The store mode is tuned too, in a nested context: regular stores, or
+ * streaming (non-temporal) stores that skip reading the output lines
+ * before writing them, which can pay off once the array outgrows the
+ * last level cache. So is the NUMA placement of the arrays, which are
+ * first touched in parallel: first touch, interleaved or socket local.
  *
  */
 #include <tuning_playground.hpp>
+#include <search_space.hpp>
+#include <streaming_store.hpp>
+#include <numa_placement.hpp>
+#include <random_data.hpp>
 
 #include <chrono>
 #include <cmath> // cbrt
@@ -28,60 +38,17 @@ enum schedulers{StaticSchedule, DynamicSchedule};
 static const std::string scheduleNames[] = {"static", "dynamic"};
 namespace KTE = Kokkos::Tools::Experimental;
 namespace KE = Kokkos::Experimental;
+using view_type = Kokkos::View<double *, Kokkos::HostSpace>;
+using scratch_view = Kokkos::View<double *, Kokkos::OpenMP::scratch_memory_space,
+                                  Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
 
-// helper function for matrix init
-void initArray(Kokkos::View<double *, Kokkos::HostSpace>& ar, size_t d1) {
-    for(size_t i=0; i<d1; i++){
-        ar(i)=(rand() % (upperBound - lowerBound + 1)) + lowerBound;
-    }
-}
-
-// Helper function to generate tile sizes
-std::vector<int64_t> factorsOf(const int &size){
-    std::vector<int64_t> factors;
-    for(int i=1; i<size; i++){
-        if(size % i == 0){
-            factors.push_back(i);
-        }
-    }
-    return factors;
-}
-
-// Helper function to generate thread counts
-std::vector<int64_t> makeRange(const int &size){
-    std::vector<int64_t> range;
-    for(int i=2; i<=size; i+=2){
-        range.push_back(i);
-    }
-    return range;
-}
-
-// helper function for human output
-void reportOptions(std::vector<int64_t>& candidates,
-    std::string name, size_t size) {
-    std::cout<<"Chunk size options for " << name << "="<<size<<std::endl;
-    for(auto &i : candidates){ std::cout<<i<<", "; }
-    std::cout<<std::endl;
-}
-
-// helper function for declaring output tiling variables
-size_t declareOutputTileSize(std::string name, std::string varname, size_t limit) {
-    size_t out_value_id;
-    // create a vector of potential values
-    std::vector<int64_t> candidates = factorsOf(limit);
-    reportOptions(candidates, name, limit);
-    // create our variable object
-    KTE::VariableInfo out_info;
-    // set the variable details
-    out_info.type = KTE::ValueType::kokkos_value_int64;
-    out_info.category = KTE::StatisticalCategory::kokkos_value_categorical;
-    out_info.valueQuantity = KTE::CandidateValueType::kokkos_value_set;
-    out_info.candidates = KTE::make_candidate_set(candidates.size(),candidates.data());
-    // declare the variable
-    out_value_id = KTE::declare_output_type(varname,out_info);
-    // return the id
-    return out_value_id;
-}
+// the team decomposition of one stencil step
+struct team_shape {
+    int tile;
+    int team_size;
+    int vector_length;
+    int scratch_level;
+};
 
 // helper function for declaring input size variables
 size_t declareInputViewSize(std::string varname, int64_t size) {
@@ -118,28 +85,50 @@ size_t declareOutputSchedules(std::string varname) {
     return schedule_out_value_id;
 }
 
-// helper function for declaring output tread count variable
-size_t declareOutputThreadCount(std::string varname, size_t limit) {
-    size_t out_value_id;
-    // create a vector of potential values
-    std::vector<int64_t> candidates = makeRange(limit);
-    // create our variable object
-    KTE::VariableInfo out_info;
-    // set the variable details
-    out_info.type = KTE::ValueType::kokkos_value_int64;
-    out_info.category = KTE::StatisticalCategory::kokkos_value_categorical;
-    out_info.valueQuantity = KTE::CandidateValueType::kokkos_value_set;
-    out_info.candidates = KTE::make_candidate_set(candidates.size(),candidates.data());
-    // declare the variable
-    out_value_id = KTE::declare_output_type(varname,out_info);
-    // return the id
-    return out_value_id;
+/* One stencil step. Every team takes one tile, stages it and its halo
+ * in scratch memory, then the team threads take blocks of vector_length
+ * cells and the vector lanes update the cells of a block. The stores to
+ * dest are streaming if Streaming. */
+template<typename Schedule, bool Streaming>
+void team_stencil(const view_type& source, const view_type& dest, const team_shape& shape) {
+    using team_policy = Kokkos::TeamPolicy<Kokkos::Schedule<Schedule>, Kokkos::OpenMP>;
+    using member_type = typename team_policy::member_type;
+    const int tile = shape.tile;
+    const int vector_length = shape.vector_length;
+    const int scratch_level = shape.scratch_level;
+    const int league_size = (length + tile - 1) / tile;
+    const auto policy = team_policy(league_size, shape.team_size, vector_length)
+        .set_scratch_size(scratch_level, Kokkos::PerTeam(scratch_view::shmem_size(tile + 2)));
+    Kokkos::parallel_for("openmp team heat_transfer", policy,
+        KOKKOS_LAMBDA(const member_type& member) {
+            const int start = member.league_rank() * tile;
+            const int count = Kokkos::min(tile, length - start);
+            // halo(i + 1) holds source(start + i)
+            scratch_view halo(member.team_scratch(scratch_level), tile + 2);
+            Kokkos::parallel_for(Kokkos::TeamThreadRange(member, count + 2), [&](const int i) {
+                const int x = start + i - 1;
+                halo(i) = (x >= 0 && x < length) ? source(x) : 0.0;
+            });
+            member.team_barrier();
+            const int blocks = (count + vector_length - 1) / vector_length;
+            Kokkos::parallel_for(Kokkos::TeamThreadRange(member, blocks), [&](const int block) {
+                const int first = block * vector_length;
+                const int last = Kokkos::min(first + vector_length, count);
+                Kokkos::parallel_for(Kokkos::ThreadVectorRange(member, first, last), [&](const int i) {
+                    const int x = start + i;
+                    // To keep the kernel simple, we don't update first or last cells
+                    if (x > 0 && x < length - 1) {
+                        Impl::store<Streaming>(&dest(x), (halo(i) + halo(i + 1) + halo(i + 2)) / 3.0);
+                    }
+                });
+            });
+            Impl::store_fence<Streaming>();
+        });
 }
 
 int main(int argc, char *argv[]) {
     // surely there is a way to get this from Kokkos?
     bool tuning = false;
-    bool internal_tuning = Kokkos::tune_internals();
     char * tmp{getenv("APEX_KOKKOS_TUNING")};
     if (tmp != nullptr) {
         std::string tmpstr {tmp};
@@ -150,30 +139,19 @@ int main(int argc, char *argv[]) {
     Kokkos::initialize(argc, argv);
     {
         Kokkos::print_configuration(std::cout, false);
-        /* To keep the kernel simple, we don't update first or last cells */
-        int min_index = 1;
-        int max_index = length - 1;
         /* Create initial view */
-        Kokkos::View<double *, Kokkos::HostSpace> left("left stencil", length);
+        view_type left(Kokkos::view_alloc(Kokkos::WithoutInitializing, "left stencil"), length);
+        first_touch(left);
         /* Initialize the view */
-        initArray(left, length);
+        fill_uniform(left, lowerBound, upperBound);
         /* Create a destination view */
-        Kokkos::View<double *, Kokkos::HostSpace> right("right stencil", length);
+        view_type right(Kokkos::view_alloc(Kokkos::WithoutInitializing, "right stencil"), length);
+        first_touch(right);
         /* Copy the initial view */
         Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, right, left);
-        /* Create two view references, a source and a destination */
-        auto& source = left;
-        auto& dest = right;
-        /* Simple 1d, 3-point stencil update - use the average of the left, right and current cells */
-        const auto kernel = KOKKOS_LAMBDA(const Kokkos::TeamPolicy<Kokkos::OpenMP>::member_type &team_member) {
-            // Calculate a global thread id
-            int x = team_member.league_rank () * team_member.team_size () +
-                team_member.team_rank ();
-            if (x < min_index || x == max_index) {
-                return;
-            }
-            dest(x) = (source(x-1) + source(x) + source(x+1)) / 3.0;
-        };
+        /* Two view handles, a source and a destination, swapped every step */
+        view_type source = left;
+        view_type dest = right;
 
         // Context variable setup - needed to generate a unique context hash for tuning.
         // Declare the input variables and store the variable IDs
@@ -187,65 +165,94 @@ int main(int argc, char *argv[]) {
             KTE::make_variable_value(id[1], "parallel_for"),
             KTE::make_variable_value(id[2], int64_t(length))
         };
-        // Declare the ouptut variables and store the variable IDs
-        size_t out_value_id[3];
-        out_value_id[0] = declareOutputTileSize("length", "chunk_out", length);
-        out_value_id[1] = declareOutputSchedules("schedule_out");
         int64_t max_threads = std::min(std::thread::hardware_concurrency(),
                 (unsigned int)(Kokkos::OpenMP::concurrency()));
-        out_value_id[2] = declareOutputThreadCount("thread_count", max_threads);
+
+        /* The tile size, team size, vector length and scratch level are
+         * tuned as one space, because they constrain each other. */
+        using team_policy = Kokkos::TeamPolicy<Kokkos::OpenMP>;
+        const auto probe = KOKKOS_LAMBDA(const team_policy::member_type&) {};
+        const int64_t team_size_max = team_policy(1, 1).team_size_max(probe, Kokkos::ParallelForTag());
+        std::vector<int64_t> tiles;
+        for (const int64_t tile : divisorsOf(length)) {
+            if (tile >= 64) {
+                tiles.push_back(tile);
+            }
+        }
+        search_space space;
+        const size_t d_tile = space.add_dimension("tile", log_spaced(tiles, 8));
+        const size_t d_team = space.add_dimension("team_size", powersOfTwoUpTo(team_size_max));
+        const size_t d_vector = space.add_dimension("vector_length",
+            powersOfTwoUpTo(std::min<int64_t>(32, team_policy::vector_length_max())));
+        const size_t d_level = space.add_dimension("scratch_level", {0, 1});
+        space.add_constraint("halo tile fits in scratch", [=](const search_space::point& p) {
+            return scratch_view::shmem_size(p[d_tile] + 2) <=
+                size_t(team_policy::scratch_size_max(p[d_level]));
+        });
+        space.add_constraint("every vector lane has work", [=](const search_space::point& p) {
+            return p[d_tile] >= p[d_team] * p[d_vector];
+        });
+        space.add_constraint("enough tiles for the threads", [=](const search_space::point& p) {
+            return (length / p[d_tile]) * p[d_team] >= max_threads;
+        });
+        size_t shape_out = space.declare_output("team_shape");
+        // Declare the ouptut variables and store the variable IDs
+        size_t schedule_out = declareOutputSchedules("schedule_out");
+        // start from 4096-cell tiles in level 0 scratch, if that is feasible
+        const int64_t default_shape = std::max<int64_t>(0, space.index_of({4096, 1, 1, 0}));
         //The second argument to make_varaible_value is a default value
         std::vector<KTE::VariableValue> answer_vector{
-            KTE::make_variable_value(out_value_id[0], int64_t(length/max_threads)),
-            KTE::make_variable_value(out_value_id[1], int64_t(StaticSchedule)),
-            KTE::make_variable_value(out_value_id[2], int64_t(max_threads))
+            KTE::make_variable_value(shape_out, default_shape),
+            KTE::make_variable_value(schedule_out, int64_t(StaticSchedule))
         };
 
-
+        store_mode_tuner stores("1d_stencil_team");
+        numa_placement_tuner placement("1d_stencil_team");
+        // the handles the kernel runs on, which the placement repoints
+        placement.track(source);
+        placement.track(dest);
+        // latches the tuning decision once it has converged
+        Impl::tuning_latch latch;
         Kokkos::Profiling::ScopedRegion region("1d_stencil_team search loop");
 
         /* We iterate so that we have enough samples to explore the search space.
          * In a real application, this kernel would get called multiple times over
          * the course of a simulation, and would eventually(?) converge. */
-        for (int i = 0 ; i < Impl::max_iterations ; i++) {
-            // request a context id
-            size_t context = KTE::get_new_context_id();
-            // start the context
-            KTE::begin_context(context);
-            // set the input values for the context
-            KTE::set_input_values(context, input_vector.size(), input_vector.data());
-            // request new output values for the context
-            KTE::request_output_values(context, answer_vector.size(), answer_vector.data());
-            // get the chunk size
-            int chunk{static_cast<int>(answer_vector[0].value.int_value)};
-            // get our schedule and thread count
-            int scheduleType = answer_vector[1].value.int_value;
-            // there's probably a better way to set the thread count?
-            int num_threads = answer_vector[2].value.int_value;
-            int league_size{1};
-
-            // no tuning?
-            if (!tuning) {
-                Kokkos::parallel_for("openmp static heat_transfer",
-                    Kokkos::TeamPolicy<Kokkos::Schedule<Kokkos::Static>, Kokkos::OpenMP>(
-                        league_size, Kokkos::AUTO, Kokkos::AUTO), kernel);
-            } else if (scheduleType == StaticSchedule) {
-                Kokkos::parallel_for("openmp dynamic heat_transfer",
-                    Kokkos::TeamPolicy<Kokkos::Schedule<Kokkos::Static>, Kokkos::OpenMP>(
-                        league_size, num_threads, chunk), kernel);
-            } else { // Dynamic schedule
-                Kokkos::parallel_for("openmp dynamic heat_transfer",
-                    Kokkos::TeamPolicy<Kokkos::Schedule<Kokkos::Dynamic>, Kokkos::OpenMP>(
-                        league_size, num_threads, chunk), kernel);
+        Impl::benchmark bench("1d_stencil_team");
+        bench.run(Impl::max_iterations, [&](const int) {
+            // open a context with the input values, and request new output values
+            // for it, unless the latched ones are to be reused
+            Impl::tuning_scope scope(latch);
+            scope.request(answer_vector.data(), answer_vector.size(),
+                input_vector.data(), input_vector.size());
+            // get the team shape
+            const int64_t shape_index = tuning ? answer_vector[0].value.int_value : default_shape;
+            const search_space::point& point = space.at(shape_index);
+            const team_shape shape{int(point[d_tile]), int(point[d_team]),
+                                   int(point[d_vector]), int(point[d_level])};
+            // get our schedule
+            int scheduleType = tuning ? answer_vector[1].value.int_value : StaticSchedule;
+            if (tuning) {
+                bench.configuration(space.describe(shape_index) +
+                    ",schedule=" + scheduleNames[scheduleType]);
             }
+
+            placement([&]() {
+                stores(dest.span() * sizeof(double), [&](auto streaming) {
+                    constexpr bool stream = decltype(streaming)::value;
+                    if (scheduleType == StaticSchedule) {
+                        team_stencil<Kokkos::Static, stream>(source, dest, shape);
+                    } else { // Dynamic schedule
+                        team_stencil<Kokkos::Dynamic, stream>(source, dest, shape);
+                    }
+                });
+            });
             // end the context
-            KTE::end_context(context);
+            scope.close();
 
             /* Swap the views */
-            auto& tmp = source;
-            source = dest;
-            dest = tmp;
-        }
+            std::swap(source, dest);
+        });
     }
     Kokkos::finalize();
 }
@@ -14,6 +14,8 @@
  *
  */
 #include <tuning_playground.hpp>
+#include <numa_placement.hpp>
+#include <random_data.hpp>
 
 #include <chrono>
 #include <cmath> // cbrt
@@ -26,13 +28,6 @@ constexpr int length{1048576}; // array length
 constexpr int lowerBound{100};
 constexpr int upperBound{999};
 
-// helper function for matrix init
-void initArray(Kokkos::View<double *, Kokkos::HostSpace>& ar, size_t d1) {
-    for(size_t i=0; i<d1; i++){
-        ar(i)=(rand() % (upperBound - lowerBound + 1)) + lowerBound;
-    }
-}
-
 int main(int argc, char *argv[]) {
     Kokkos::initialize(argc, argv);
     {
@@ -41,11 +36,13 @@ int main(int argc, char *argv[]) {
         int min_index = 1;
         int max_index = length - 1;
         /* Create initial view */
-        Kokkos::View<double *, Kokkos::HostSpace> left("left stencil", length);
+        Kokkos::View<double *, Kokkos::HostSpace> left(Kokkos::view_alloc(Kokkos::WithoutInitializing, "left stencil"), length);
+        first_touch(left);
         /* Initialize the view */
-        initArray(left, length);
+        fill_uniform(left, lowerBound, upperBound);
         /* Create a destination view */
-        Kokkos::View<double *, Kokkos::HostSpace> right("right stencil", length);
+        Kokkos::View<double *, Kokkos::HostSpace> right(Kokkos::view_alloc(Kokkos::WithoutInitializing, "right stencil"), length);
+        first_touch(right);
         /* Copy the initial view */
         Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, right, left);
         /* Create two view references, a source and a destination */
@@ -61,12 +58,14 @@ int main(int argc, char *argv[]) {
             }
             dest(x) = (source(x-1) + source(x) + source(x+1)) / 3.0;
         };
+        fastest_of_tuner choose_one("choose_one", 2);
         Kokkos::Profiling::ScopedRegion region("1d_stencil_team_auto search loop");
         /* We iterate so that we have enough samples to explore the search space.
          * In a real application, this kernel would get called multiple times over
          * the course of a simulation, and would eventually(?) converge. */
-        for (int i = 0 ; i < Impl::max_iterations ; i++) {
-            fastest_of( "choose_one", 2, [&]() {
+        Impl::benchmark bench("1d_stencil_team_auto");
+        bench.run(Impl::max_iterations, [&](const int) {
+            fastest_of(choose_one, [&]() {
                 /* Option 1: dynamic schedule OpenMP host space */
                 Kokkos::parallel_for("openmp dynamic heat_transfer",
                     Kokkos::TeamPolicy<Kokkos::Schedule<Kokkos::Dynamic>, Kokkos::OpenMP>(1,Kokkos::AUTO,Kokkos::AUTO),
@@ -82,7 +81,7 @@ int main(int argc, char *argv[]) {
             auto& tmp = source;
             source = dest;
             dest = tmp;
-        }
+        });
     }
     Kokkos::finalize();
 }
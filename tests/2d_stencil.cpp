@@ -8,13 +8,20 @@
  *
  * This problem uses an MDRange policy for both instances, and the kernel
  * is the same for both instances. However, there are two Engine instances
- * to choose between: Serial and Static OpenMP.
+ * to choose between: Serial and Static OpenMP. The third instance is
+ * temporally blocked: it advances tiles several timesteps at a time, with
+ * a tuned time-block depth and tile size. The fourth is explicitly
+ * vectorized along y with Kokkos SIMD, with a tuned width.
  *
  * In addition, Kokkos will internally tune the tiling factors for the MDRange,
  * for both the serial and the OpenMP instantiations.
  *
  */
 #include <tuning_playground.hpp>
+#include <temporal_blocking.hpp>
+#include <simd_stencil.hpp>
+#include <numa_placement.hpp>
+#include <random_data.hpp>
 
 #include <chrono>
 #include <cmath> // cbrt
@@ -26,13 +33,24 @@
 constexpr int length{64};
 constexpr int lowerBound{100};
 constexpr int upperBound{999};
+using view_type = Kokkos::View<double **, Kokkos::HostSpace>;
 
-// helper function for matrix init
-void initArray(Kokkos::View<double **, Kokkos::HostSpace>& ar, size_t d1, size_t d2) {
-    for(size_t i=0; i<d1; i++){
-        for(size_t j=0; j<d2; j++){
-            ar(i,j)=(rand() % (upperBound - lowerBound + 1)) + lowerBound;
-        }
+/* Simple 2d, 9-point stencil update - use the average of the surrounding
+ * and current cells, for temporal_steps timesteps with the given policy.
+ * A function template rather than a generic lambda, because CUDA can't
+ * define the device lambda inside a generic one. */
+template<typename Policy>
+void sweeps(const std::string& name, const Policy& policy, view_type& source, view_type& dest) {
+    for (int step = 0 ; step < temporal_steps ; step++) {
+        const view_type from = source;
+        const view_type to = dest;
+        Kokkos::parallel_for(name, policy, KOKKOS_LAMBDA(const int x, const int y) {
+            to(x,y) = (from(x-1,y-1) + from(x,y-1) + from(x+1,y-1) +
+                       from(x-1,y)   + from(x,y)   + from(x+1,y)   +
+                       from(x-1,y+1) + from(x,y+1) + from(x+1,y+1)) / 9.0;
+        });
+        /* Swap the views */
+        std::swap(source, dest);
     }
 }
 
@@ -44,48 +62,58 @@ int main(int argc, char *argv[]) {
         int min_index = 1;
         int max_index = length - 1;
         /* Create initial view */
-        Kokkos::View<double **, Kokkos::HostSpace> left("left stencil", length, length);
+        Kokkos::View<double **, Kokkos::HostSpace> left(Kokkos::view_alloc(Kokkos::WithoutInitializing, "left stencil"), length, length);
+        first_touch(left);
         /* Initialize the view */
-        initArray(left, length, length);
+        fill_uniform(left, lowerBound, upperBound);
         /* Create a destination view */
-        Kokkos::View<double **, Kokkos::HostSpace> right("right stencil", length, length);
+        Kokkos::View<double **, Kokkos::HostSpace> right(Kokkos::view_alloc(Kokkos::WithoutInitializing, "right stencil"), length, length);
+        first_touch(right);
         /* Copy the initial view */
         Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, right, left);
         /* Create two view references, a source and a destination */
         auto& source = left;
         auto& dest = right;
-        /* Simple 2d, 9-point stencil update - use the average of the surrounding and current cells */
-        const auto kernel = KOKKOS_LAMBDA(const int x, const int y) {
-            dest(x,y) = (source(x-1,y-1) + source(x,y-1) + source(x+1,y-1) +
-                         source(x-1,y)   + source(x,y)   + source(x+1,y)   +
-                         source(x-1,y+1) + source(x,y+1) + source(x+1,y+1)) / 9.0;
+        /* The same update, for the temporally blocked and SIMD variants */
+        const auto stencil = KOKKOS_LAMBDA(const auto& at) {
+            return (at(-1,-1) + at(0,-1) + at(1,-1) +
+                    at(-1,0)  + at(0,0)  + at(1,0)  +
+                    at(-1,1)  + at(0,1)  + at(1,1)) / 9.0;
         };
+        fastest_of_tuner choose_one("choose_one", 4);
+        temporal_blocking blocked("2d_stencil", 2, {8, 16, 32, 64});
+        simd_width_tuner simd("2d_stencil");
         Kokkos::Profiling::ScopedRegion region("2d_stencil search loop");
         /* We iterate so that we have enough samples to explore the search space.
          * In a real application, this kernel would get called multiple times over
          * the course of a simulation, and would eventually(?) converge. */
-        for (int i = 0 ; i < Impl::max_iterations ; i++) {
-            fastest_of( "choose_one", 2, [&]() {
+        Impl::benchmark bench("2d_stencil");
+        bench.run(Impl::max_iterations, [&](const int) {
+            fastest_of(choose_one, [&]() {
                 /* Option 1: serial host space */
-                Kokkos::parallel_for("serial 2D heat_transfer",
+                sweeps("serial 2D heat_transfer",
                     Kokkos::MDRangePolicy<Kokkos::Serial,
-                        Kokkos::Rank<2>>({min_index, min_index}, {max_index, max_index}),
-                    kernel);
-                    //std::cout << "serial" << std::endl;
+                        Kokkos::Rank<2>>({min_index, min_index}, {max_index, max_index}), source, dest);
                 }, [&]() {
                 /* Option 2: OpenMP host space */
-                Kokkos::parallel_for("openmp 2D heat_transfer",
+                sweeps("openmp 2D heat_transfer",
                     Kokkos::MDRangePolicy<Kokkos::OpenMP,
-                        Kokkos::Rank<2>>({min_index, min_index}, {max_index, max_index}),
-                    kernel);
-                    //std::cout << "openmp" << std::endl;
+                        Kokkos::Rank<2>>({min_index, min_index}, {max_index, max_index}), source, dest);
+                }, [&]() {
+                /* Option 3: temporally blocked tiles, several timesteps per tile */
+                blocked(source, dest, stencil);
+                }, [&]() {
+                /* Option 4: explicit SIMD, with a tuned vector width */
+                simd([&](auto abi) {
+                    for (int step = 0 ; step < temporal_steps ; step++) {
+                        simd_sweep<decltype(abi)>("simd 2D heat_transfer", source, dest,
+                            min_index, max_index, stencil);
+                        std::swap(source, dest);
+                    }
+                });
                 }
             );
-            /* Swap the views */
-            auto& tmp = source;
-            source = dest;
-            dest = tmp;
-        }
+        });
     }
     Kokkos::finalize();
 }
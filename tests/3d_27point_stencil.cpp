@@ -6,25 +6,56 @@
  *
  * Kokkos is executing a simple 3d stencil annealing (heat transfer) problem.
  *
- * This problem uses an MDRange policy for both instances, and the kernel
- * is the same for both instances. However, there are two Engine instances
- * to choose between: Serial and Static OpenMP.
+ * There are seven instances to choose between:
+ *  - a naive MDRange sweep, with 27 loads per point
+ *  - a temporally blocked one that advances cache-sized tiles several
+ *    timesteps at a time, with a tuned time-block depth and tile size
+ *  - a separable one, where each work item walks one z column and keeps a
+ *    rolling window of the 3x3 partial sums, with 9 loads per point
+ *  - a register blocked one, where each work item computes a tuned number
+ *    of consecutive (unit-stride) z outputs from shared partial sums
+ *  - an unrolled one, where each work item computes a tuned number of
+ *    consecutive x outputs from shared yz-plane partial sums
+ *  - one that sweeps a z row per work item, with a tuned store mode:
+ *    regular stores, or streaming (non-temporal) stores that skip reading
+ *    the output lines before writing them
+ *  - an explicitly vectorized one along z, with Kokkos SIMD and a tuned
+ *    vector width
  *
- * In addition, Kokkos will internally tune the tiling factors for the MDRange,
- * for both the serial and the OpenMP instantiations.
+ * The last two use the host's streaming stores and vector units, so they
+ * are left out of GPU builds.
+ *
+ * After the search, the variants with a fixed memory access pattern are
+ * timed on their own, for every blocking factor, and reported in GFLOP/s,
+ * in GB/s of compulsory memory traffic and in grid loads per point.
+ *
+ * In addition, Kokkos will internally tune the tiling factors for the MDRange.
+ *
+ * With PLAYGROUND_SNAPSHOT_DIR set, the input is loaded from a snapshot
+ * there (and saved on the first run), and the result of the search is
+ * saved before the variants are timed on their own, to compare between
+ * runs.
  *
  */
 #include <tuning_playground.hpp>
-#include <Kokkos_Random.hpp>
+#include <temporal_blocking.hpp>
+#include <search_space.hpp>
+#include <simd_stencil.hpp>
+#include <streaming_store.hpp>
+#include <view_snapshot.hpp>
 
 #include <chrono>
 #include <cmath> // cbrt
 #include <cstdlib>
+#include <iomanip>
 #include <iostream>
 #include <random>
 #include <tuple>
 
 constexpr int length{128};
+/* 26 additions and a division per point, whichever way they are grouped */
+constexpr double flops_per_point{27.0};
+using view_type = Kokkos::View<double ***, Kokkos::DefaultExecutionSpace::memory_space>;
 
 // helper function for matrix init
 void initArray(Kokkos::View<double ***, Kokkos::DefaultExecutionSpace::memory_space>& ar, size_t d1, size_t d2, size_t d3) {
@@ -37,6 +68,163 @@ void initArray(Kokkos::View<double ***, Kokkos::DefaultExecutionSpace::memory_sp
             ({0, 0, 0}, {d1, d2, d3}), kernel);
 }
 
+// the 3x3 sum of the x-y neighbours of (x, y, z)
+KOKKOS_INLINE_FUNCTION double column_sum(const view_type& from, const int x, const int y, const int z) {
+    return from(x-1,y-1,z) + from(x-1,y,z) + from(x-1,y+1,z) +
+           from(x,y-1,z) + from(x,y,z) + from(x,y+1,z) +
+           from(x+1,y-1,z) + from(x+1,y,z) + from(x+1,y+1,z);
+}
+
+// the 3x3 sum of the y-z neighbours of (x, y, z)
+KOKKOS_INLINE_FUNCTION double plane_sum(const view_type& from, const int x, const int y, const int z) {
+    return from(x,y-1,z-1) + from(x,y-1,z) + from(x,y-1,z+1) +
+           from(x,y,z-1) + from(x,y,z) + from(x,y,z+1) +
+           from(x,y+1,z-1) + from(x,y+1,z) + from(x,y+1,z+1);
+}
+
+/* Every work item walks one z column, keeping the column sums of the
+ * three planes it needs, so each point costs one new column sum. */
+void separable_sweep(const view_type& from, const view_type& to, const int lo, const int hi) {
+    Kokkos::parallel_for("3D 27-point jacobi, separable",
+        Kokkos::MDRangePolicy<Kokkos::DefaultExecutionSpace, Kokkos::Rank<2>>({lo, lo}, {hi, hi}),
+        KOKKOS_LAMBDA(const int x, const int y) {
+            double below = column_sum(from, x, y, lo - 1);
+            double here = column_sum(from, x, y, lo);
+            for (int z = lo ; z < hi ; z++) {
+                const double above = column_sum(from, x, y, z + 1);
+                to(x,y,z) = (below + here + above) / 27.0;
+                below = here;
+                here = above;
+            }
+        });
+}
+
+/* Every work item computes Block consecutive z outputs, from Block + 2
+ * column sums kept in registers. */
+template<int Block>
+void z_blocked_sweep(const view_type& from, const view_type& to, const int lo, const int hi) {
+    const int blocks = (hi - lo + Block - 1) / Block;
+    Kokkos::parallel_for("3D 27-point jacobi, z blocked",
+        Kokkos::MDRangePolicy<Kokkos::DefaultExecutionSpace, Kokkos::Rank<3>>({lo, lo, 0}, {hi, hi, blocks}),
+        KOKKOS_LAMBDA(const int x, const int y, const int b) {
+            const int z0 = lo + b * Block;
+            double sums[Block + 2];
+            for (int c = 0 ; c < Block + 2 ; c++) {
+                // past the last block, these sums are never used
+                sums[c] = column_sum(from, x, y, Kokkos::min(z0 - 1 + c, hi));
+            }
+            for (int c = 0 ; c < Block ; c++) {
+                if (z0 + c < hi) {
+                    to(x,y,z0+c) = (sums[c] + sums[c+1] + sums[c+2]) / 27.0;
+                }
+            }
+        });
+}
+
+/* Every work item computes Unroll consecutive x outputs, from Unroll + 2
+ * yz-plane sums kept in registers. */
+template<int Unroll>
+void x_unrolled_sweep(const view_type& from, const view_type& to, const int lo, const int hi) {
+    const int blocks = (hi - lo + Unroll - 1) / Unroll;
+    Kokkos::parallel_for("3D 27-point jacobi, x unrolled",
+        Kokkos::MDRangePolicy<Kokkos::DefaultExecutionSpace, Kokkos::Rank<3>>({0, lo, lo}, {blocks, hi, hi}),
+        KOKKOS_LAMBDA(const int b, const int y, const int z) {
+            const int x0 = lo + b * Unroll;
+            double sums[Unroll + 2];
+            for (int c = 0 ; c < Unroll + 2 ; c++) {
+                sums[c] = plane_sum(from, Kokkos::min(x0 - 1 + c, hi), y, z);
+            }
+            for (int c = 0 ; c < Unroll ; c++) {
+                if (x0 + c < hi) {
+                    to(x0+c,y,z) = (sums[c] + sums[c+1] + sums[c+2]) / 27.0;
+                }
+            }
+        });
+}
+
+/* Register blocking factors are template parameters, so the tuned
+ * factor picks one of these instantiations. */
+const std::vector<int64_t> blocking_factors{1, 2, 4, 8, 16};
+
+template<template<int> typename Sweep>
+void blocked_sweep(const int64_t factor, const view_type& from, const view_type& to,
+                   const int lo, const int hi) {
+    switch (factor) {
+        case 1: Sweep<1>{}(from, to, lo, hi); break;
+        case 2: Sweep<2>{}(from, to, lo, hi); break;
+        case 4: Sweep<4>{}(from, to, lo, hi); break;
+        case 8: Sweep<8>{}(from, to, lo, hi); break;
+        default: Sweep<16>{}(from, to, lo, hi); break;
+    }
+}
+
+template<int Block> struct z_blocked {
+    void operator()(const view_type& from, const view_type& to, const int lo, const int hi) const {
+        z_blocked_sweep<Block>(from, to, lo, hi);
+    }
+};
+
+template<int Unroll> struct x_unrolled {
+    void operator()(const view_type& from, const view_type& to, const int lo, const int hi) const {
+        x_unrolled_sweep<Unroll>(from, to, lo, hi);
+    }
+};
+
+/* A register blocking factor, tuned in a context of its own, nested in the
+ * fastest_of context of the variant that uses it. */
+class tuned_factor {
+public:
+    tuned_factor(const std::string& name) {
+        Kokkos::Tools::Experimental::VariableInfo out_info;
+        out_info.type = Kokkos::Tools::Experimental::ValueType::kokkos_value_int64;
+        out_info.category = Kokkos::Tools::Experimental::StatisticalCategory::kokkos_value_ordinal;
+        out_info.valueQuantity = Kokkos::Tools::Experimental::CandidateValueType::kokkos_value_set;
+        out_info.candidates = Kokkos::Tools::Experimental::make_candidate_set(
+            candidates_.size(), candidates_.data());
+        answer_.push_back(Kokkos::Tools::Experimental::make_variable_value(
+            Kokkos::Tools::Experimental::declare_output_type(name, out_info), int64_t(4)));
+    }
+
+    // call body with the factor to use
+    template<typename Body>
+    void operator()(Body body) {
+        Impl::tuning_scope scope(latch_, answer_.data(), answer_.size());
+        body(answer_[0].value.int_value);
+    }
+
+private:
+    std::vector<int64_t> candidates_{blocking_factors};
+    std::vector<Kokkos::Tools::Experimental::VariableValue> answer_;
+    Impl::tuning_latch latch_;
+};
+
+/* Times one variant on its own and prints its rates. The bandwidth counts
+ * only the compulsory traffic, one read and one write of each point; loads
+ * is the number of values each point reads from the grid, whether they
+ * hit in cache or not, and is printed as it is. */
+template<typename Variant>
+void report(const std::string& name, const double loads, Variant variant) {
+    constexpr int calls{10};
+    const double points = double(length - 2) * (length - 2) * (length - 2) * temporal_steps;
+    variant();
+    Kokkos::fence();
+    Kokkos::Timer timer;
+    for (int i = 0 ; i < calls ; i++) {
+        variant();
+    }
+    Kokkos::fence();
+    const double seconds = timer.seconds() / calls;
+    const auto flags = std::cout.flags();
+    const auto precision = std::cout.precision();
+    std::cout << std::setw(24) << std::left << name << std::right
+              << std::setw(10) << std::fixed << std::setprecision(2)
+              << flops_per_point * points / seconds * 1.0e-9 << " GFLOP/s"
+              << std::setw(10) << 2.0 * sizeof(double) * points / seconds * 1.0e-9 << " GB/s"
+              << std::setw(10) << loads << " loads/point" << std::endl;
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
 int main(int argc, char *argv[]) {
     Kokkos::initialize(argc, argv);
     {
@@ -45,13 +233,13 @@ int main(int argc, char *argv[]) {
         int min_index = 1;
         int max_index = length - 1;
         /* Create initial view */
-        Kokkos::View<double ***, Kokkos::DefaultExecutionSpace::memory_space> left("left stencil", length, length, length);
+        view_type left("left stencil", length, length, length);
         /* Initialize the view */
         std::cout << "init..." << std::endl;
         std::cout.flush();
-        initArray(left, length, length, length);
+        snapshot_input("3d_27point_stencil_input", left, [&]() { initArray(left, length, length, length); });
         /* Create a destination view */
-        Kokkos::View<double ***, Kokkos::DefaultExecutionSpace::memory_space> right("right stencil", length, length, length);
+        view_type right("right stencil", length, length, length);
         /* Copy the initial view */
         Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, right, left);
         /* Create two view references, a source and a destination */
@@ -59,16 +247,94 @@ int main(int argc, char *argv[]) {
         auto& dest = right;
         /* Simple 3d, 27-point stencil update -
          * use the average of the surrounding and current cells, including diagonals */
-        const auto kernel = KOKKOS_LAMBDA(const int x, const int y, const int z) {
-            double tmp = 0;
-            for(size_t i=x-1; i<=x+1; i++){
-                for(size_t j=y-1; j<=y+1; j++){
-                    for(size_t k=z-1; k<=z+1; k++){
-                        tmp = tmp + source(i,j,k);
+        const auto sweeps = [&]() {
+            for (int step = 0 ; step < temporal_steps ; step++) {
+                const view_type from = source;
+                const view_type to = dest;
+                Kokkos::parallel_for("3D 27-point jacobi",
+                    Kokkos::MDRangePolicy<Kokkos::DefaultExecutionSpace,
+                                        Kokkos::Rank<3>>
+                        ({min_index, min_index, min_index},
+                            {max_index, max_index, max_index}),
+                    KOKKOS_LAMBDA(const int x, const int y, const int z) {
+                    double tmp = 0;
+                    for(int i=x-1; i<=x+1; i++){
+                        for(int j=y-1; j<=y+1; j++){
+                            for(int k=z-1; k<=z+1; k++){
+                                tmp = tmp + from(i,j,k);
+                            }
+                        }
                     }
-                }
+                    to(x,y,z) = tmp / 27.0;
+                });
+                /* Swap the views */
+                std::swap(source, dest);
+            }
+        };
+        /* The same update, for the temporally blocked, SIMD and row variants */
+        const auto stencil = KOKKOS_LAMBDA(const auto& at) {
+            auto tmp = at(-1,-1,-1);
+            for(int n=1; n<27; n++){
+                tmp = tmp + at(n/9 - 1, (n/3)%3 - 1, n%3 - 1);
+            }
+            return tmp / 27.0;
+        };
+        /* The optimized variants, each advancing temporal_steps timesteps */
+        const auto separable = [&]() {
+            for (int step = 0 ; step < temporal_steps ; step++) {
+                separable_sweep(source, dest, min_index, max_index);
+                std::swap(source, dest);
+            }
+        };
+        const auto z_blocked_sweeps = [&](const int64_t factor) {
+            for (int step = 0 ; step < temporal_steps ; step++) {
+                blocked_sweep<z_blocked>(factor, source, dest, min_index, max_index);
+                std::swap(source, dest);
+            }
+        };
+        const auto x_unrolled_sweeps = [&](const int64_t factor) {
+            for (int step = 0 ; step < temporal_steps ; step++) {
+                blocked_sweep<x_unrolled>(factor, source, dest, min_index, max_index);
+                std::swap(source, dest);
+            }
+        };
+        const auto row_sweeps = [&](auto streaming) {
+            for (int step = 0 ; step < temporal_steps ; step++) {
+                row_sweep<decltype(streaming)::value>("3D 27-point jacobi, rows", source, dest,
+                    min_index, max_index, stencil);
+                std::swap(source, dest);
             }
-            dest(x,y,z) = tmp / 27.0;
+        };
+        /* The row and SIMD variants use the host's streaming stores and
+         * vector units, so they are only offered when the grid is in host
+         * accessible memory. */
+        constexpr bool host_grid{Impl::host_accessible<view_type::memory_space>};
+        fastest_of_tuner choose_one("choose_one", host_grid ? 7 : 5);
+        temporal_blocking blocked("3d_27point_stencil", 3, {8, 16, 32, 64});
+        tuned_factor z_block("3d_27point_stencil_z_block");
+        tuned_factor x_unroll("3d_27point_stencil_x_unroll");
+        simd_width_tuner simd("3d_27point_stencil");
+        store_mode_tuner stores("3d_27point_stencil");
+        /* Every option advances temporal_steps timesteps */
+        const auto option_sweeps = [&]() {
+            /* Option 1: one sweep of the grid per timestep */
+            sweeps();
+        };
+        const auto option_blocked = [&]() {
+            /* Option 2: temporally blocked tiles, several timesteps per tile */
+            blocked(source, dest, stencil);
+        };
+        const auto option_separable = [&]() {
+            /* Option 3: rolling 3x3 partial sums along z */
+            separable();
+        };
+        const auto option_z_blocked = [&]() {
+            /* Option 4: register blocked along z, by a tuned factor */
+            z_block(z_blocked_sweeps);
+        };
+        const auto option_x_unrolled = [&]() {
+            /* Option 5: unrolled along x, by a tuned factor */
+            x_unroll(x_unrolled_sweeps);
         };
         std::cout << "compute..." << std::endl;
         std::cout.flush();
@@ -76,17 +342,53 @@ int main(int argc, char *argv[]) {
         /* We iterate so that we have enough samples to explore the search space.
          * In a real application, this kernel would get called multiple times over
          * the course of a simulation, and would eventually(?) converge. */
-        for (int i = 0 ; i < 4 * Impl::max_iterations ; i++) {
-                Kokkos::parallel_for("3D 27-point jacobi",
-                    Kokkos::MDRangePolicy<Kokkos::DefaultExecutionSpace,
-                                        Kokkos::Rank<3>>
-                        ({min_index, min_index, min_index},
-                            {max_index, max_index, max_index}),
-                    kernel);
-            /* Swap the views */
-            auto& tmp = source;
-            source = dest;
-            dest = tmp;
+        Impl::benchmark bench("3d_27point_stencil");
+        bench.run(Impl::max_iterations, [&](const int) {
+            Impl::on_host<view_type::memory_space>([&](auto host) {
+                if constexpr (decltype(host)::value) {
+                    fastest_of(choose_one, option_sweeps, option_blocked, option_separable,
+                        option_z_blocked, option_x_unrolled, [&]() {
+                        /* Option 6: a z row per work item, with a tuned store mode */
+                        stores(dest.span() * sizeof(double), [&](auto streaming) {
+                            row_sweeps(streaming);
+                        });
+                    }, [&]() {
+                        /* Option 7: explicit SIMD, with a tuned vector width */
+                        simd([&](auto abi) {
+                            for (int step = 0 ; step < temporal_steps ; step++) {
+                                simd_sweep<decltype(abi)>("3D 27-point jacobi, simd", source, dest,
+                                    min_index, max_index, stencil);
+                                std::swap(source, dest);
+                            }
+                        });
+                    });
+                } else {
+                    fastest_of(choose_one, option_sweeps, option_blocked, option_separable,
+                        option_z_blocked, option_x_unrolled);
+                }
+            });
+        });
+        snapshot_output("3d_27point_stencil_output", source);
+        std::cout << "Per variant, " << temporal_steps << " timesteps per call:" << std::endl;
+        report("naive", 27, sweeps);
+        report("separable", 9, separable);
+        Impl::on_host<view_type::memory_space>([&](auto host) {
+            if constexpr (decltype(host)::value) {
+                // the store modes, as types that depend on host, so that
+                // the row sweeps are only instantiated in this branch
+                using regular = std::integral_constant<bool, !decltype(host)::value>;
+                using streaming = decltype(host);
+                report("rows", 27, [&]() { row_sweeps(regular{}); });
+                report("rows, streaming stores", 27, [&]() { row_sweeps(streaming{}); });
+            }
+        });
+        for (const int64_t factor : blocking_factors) {
+            report("z blocked by " + std::to_string(factor), 9.0 * (factor + 2) / factor,
+                [&]() { z_blocked_sweeps(factor); });
+        }
+        for (const int64_t factor : blocking_factors) {
+            report("x unrolled by " + std::to_string(factor), 9.0 * (factor + 2) / factor,
+                [&]() { x_unrolled_sweeps(factor); });
         }
     }
     Kokkos::finalize();
@@ -6,16 +6,28 @@
  *
  * Kokkos is executing a simple 3d stencil annealing (heat transfer) problem.
  *
- * This problem uses an MDRange policy for both instances, and the kernel
- * is the same for both instances. However, there are two Engine instances
- * to choose between: Serial and Static OpenMP.
+ * There are three instances to choose between: a naive MDRange sweep of
+ * the whole grid per timestep, a temporally blocked one that advances
+ * cache-sized tiles several timesteps at a time, with a tuned time-block
+ * depth and tile size, one explicitly vectorized along z with Kokkos
+ * SIMD, with a tuned width, and one that sweeps a z row per work item,
+ * with a tuned store mode: regular stores, or streaming (non-temporal)
+ * stores that skip reading the output lines before writing them. The
+ * SIMD and row variants use the host's vector units and streaming
+ * stores, so they are left out of GPU builds.
  *
- * In addition, Kokkos will internally tune the tiling factors for the MDRange,
- * for both the serial and the OpenMP instantiations.
+ * In addition, Kokkos will internally tune the tiling factors for the MDRange.
+ *
+ * With PLAYGROUND_SNAPSHOT_DIR set, the input is loaded from a snapshot
+ * there (and saved on the first run), and the result is saved after the
+ * search, to compare between runs.
  *
  */
 #include <tuning_playground.hpp>
-#include <Kokkos_Random.hpp>
+#include <temporal_blocking.hpp>
+#include <simd_stencil.hpp>
+#include <streaming_store.hpp>
+#include <view_snapshot.hpp>
 
 #include <chrono>
 #include <cmath> // cbrt
@@ -49,7 +61,7 @@ int main(int argc, char *argv[]) {
         /* Initialize the view */
         std::cout << "init..." << std::endl;
         std::cout.flush();
-        initArray(left, length, length, length);
+        snapshot_input("3d_7point_stencil_input", left, [&]() { initArray(left, length, length, length); });
         /* Create a destination view */
         Kokkos::View<double ***, Kokkos::DefaultExecutionSpace::memory_space> right("right stencil", length, length, length);
         /* Copy the initial view */
@@ -60,10 +72,47 @@ int main(int argc, char *argv[]) {
         /* Simple 3d, 27-point stencil update -
          * use the average of the surrounding and current cells,
          * but don't use diagonals. */
-        const auto kernel = KOKKOS_LAMBDA(const int x, const int y, const int z) {
-            dest(x,y,z) = (source(x,y,z-1) + source(x,y,z+1) +
-                         source(x,y-1,z) + source(x,y,z) + source(x,y+1,z) +
-                         source(x-1,y,z) + source(x+1,y,z)) / 7.0;
+        using view_type = Kokkos::View<double ***, Kokkos::DefaultExecutionSpace::memory_space>;
+        const auto sweeps = [&]() {
+            for (int step = 0 ; step < temporal_steps ; step++) {
+                const view_type from = source;
+                const view_type to = dest;
+                Kokkos::parallel_for("3D 7-point jacobi",
+                    Kokkos::MDRangePolicy<Kokkos::DefaultExecutionSpace,
+                                        Kokkos::Rank<3>>
+                        ({min_index, min_index, min_index},
+                            {max_index, max_index, max_index}),
+                    KOKKOS_LAMBDA(const int x, const int y, const int z) {
+                    to(x,y,z) = (from(x,y,z-1) + from(x,y,z+1) +
+                                 from(x,y-1,z) + from(x,y,z) + from(x,y+1,z) +
+                                 from(x-1,y,z) + from(x+1,y,z)) / 7.0;
+                });
+                /* Swap the views */
+                std::swap(source, dest);
+            }
+        };
+        /* The same update, for the temporally blocked, SIMD and row variants */
+        const auto stencil = KOKKOS_LAMBDA(const auto& at) {
+            return (at(0,0,-1) + at(0,0,1) +
+                    at(0,-1,0) + at(0,0,0) + at(0,1,0) +
+                    at(-1,0,0) + at(1,0,0)) / 7.0;
+        };
+        /* The SIMD and row variants use the host's vector units and
+         * streaming stores, so they are only offered when the grid is in
+         * host accessible memory. */
+        constexpr bool host_grid{Impl::host_accessible<view_type::memory_space>};
+        fastest_of_tuner choose_one("choose_one", host_grid ? 4 : 2);
+        temporal_blocking blocked("3d_7point_stencil", 3, {8, 16, 32, 64});
+        simd_width_tuner simd("3d_7point_stencil");
+        store_mode_tuner stores("3d_7point_stencil");
+        /* Every option advances temporal_steps timesteps */
+        const auto option_sweeps = [&]() {
+            /* Option 1: one sweep of the grid per timestep */
+            sweeps();
+        };
+        const auto option_blocked = [&]() {
+            /* Option 2: temporally blocked tiles, several timesteps per tile */
+            blocked(source, dest, stencil);
         };
         std::cout << "compute..." << std::endl;
         std::cout.flush();
@@ -71,18 +120,35 @@ int main(int argc, char *argv[]) {
         /* We iterate so that we have enough samples to explore the search space.
          * In a real application, this kernel would get called multiple times over
          * the course of a simulation, and would eventually(?) converge. */
-        for (int i = 0 ; i < 4 * Impl::max_iterations ; i++) {
-                Kokkos::parallel_for("3D 7-point jacobi",
-                    Kokkos::MDRangePolicy<Kokkos::DefaultExecutionSpace,
-                                        Kokkos::Rank<3>>
-                        ({min_index, min_index, min_index},
-                            {max_index, max_index, max_index}),
-                    kernel);
-            /* Swap the views */
-            auto& tmp = source;
-            source = dest;
-            dest = tmp;
-        }
+        Impl::benchmark bench("3d_7point_stencil");
+        bench.run(Impl::max_iterations, [&](const int) {
+            Impl::on_host<view_type::memory_space>([&](auto host) {
+                if constexpr (decltype(host)::value) {
+                    fastest_of(choose_one, option_sweeps, option_blocked, [&]() {
+                        /* Option 3: a z row per work item, with a tuned store mode */
+                        stores(dest.span() * sizeof(double), [&](auto streaming) {
+                            for (int step = 0 ; step < temporal_steps ; step++) {
+                                row_sweep<decltype(streaming)::value>("3D 7-point jacobi, rows",
+                                    source, dest, min_index, max_index, stencil);
+                                std::swap(source, dest);
+                            }
+                        });
+                    }, [&]() {
+                        /* Option 4: explicit SIMD, with a tuned vector width */
+                        simd([&](auto abi) {
+                            for (int step = 0 ; step < temporal_steps ; step++) {
+                                simd_sweep<decltype(abi)>("3D 7-point jacobi, simd", source, dest,
+                                    min_index, max_index, stencil);
+                                std::swap(source, dest);
+                            }
+                        });
+                    });
+                } else {
+                    fastest_of(choose_one, option_sweeps, option_blocked);
+                }
+            });
+        });
+        snapshot_output("3d_7point_stencil_output", source);
     }
     Kokkos::finalize();
 }
@@ -0,0 +1,189 @@
+#ifndef BLOCKEDGEMM_HPP
+#define BLOCKEDGEMM_HPP
+
+#include<tuning_playground.hpp>
+#include<search_space.hpp>
+#include<algorithm>
+#include<string>
+#include<vector>
+
+namespace Impl {
+
+/* The register micro-kernel: C(i0:i0+rows, j0:j0+cols) += the product of
+ * an MR x kb micro-panel of A and a kb x NR micro-panel of B, both packed
+ * so that each step of the k loop reads MR and NR contiguous values. The
+ * MR x NR accumulator stays in registers; the edges of C are clipped
+ * when the store happens, and the packed panels are zero padded. */
+template<int MR, int NR, typename Scalar, typename ViewType>
+KOKKOS_INLINE_FUNCTION void gemm_micro_kernel(const int kb, const Scalar* a, const Scalar* b,
+                                              const ViewType& c, const int i0, const int j0,
+                                              const int rows, const int cols) {
+    Scalar acc[MR][NR] = {};
+    for (int l = 0 ; l < kb ; l++) {
+        for (int r = 0 ; r < MR ; r++) {
+            const Scalar ar = a[l * MR + r];
+            for (int cc = 0 ; cc < NR ; cc++) {
+                acc[r][cc] += ar * b[l * NR + cc];
+            }
+        }
+    }
+    for (int r = 0 ; r < rows ; r++) {
+        for (int cc = 0 ; cc < cols ; cc++) {
+            c(i0 + r, j0 + cc) += acc[r][cc];
+        }
+    }
+}
+
+} // namespace Impl
+
+/* A BLIS-style blocked GEMM engine for the host backends: C += A * B.
+ *
+ * B is taken in KC x NC panels and A in KC-deep slices, packed into
+ * micro-panels of NR columns and MR rows, and every (MC block of rows,
+ * NR micro-panel) pair is one work item, which runs the register
+ * micro-kernel down its MC rows. An MC x KC block of packed A is reused
+ * from L2 across the micro-panels of B, and a KC x NR micro-panel of B
+ * from L1 across the rows. Unlike BLIS, the whole KC slice of A is
+ * packed up front, in parallel, rather than one MC block per thread.
+ *
+ * MC, NC, KC and the MR x NR micro-tile are one tuning output, a search
+ * space constrained so the packed blocks fit their caches. The micro-tile
+ * shapes are template instantiations, so only the shapes listed here can
+ * be chosen. The output is requested in a context of its own, so the
+ * engine can be offered beside other implementations with fastest_of:
+ *
+ *   blocked_gemm<float> engine("mdrange_gemm");
+ *   fastest_of(tuner, [&]() { ...naive... },
+ *       [&]() { engine(left, right, output); });
+ */
+template<typename Scalar>
+class blocked_gemm {
+public:
+    using host_space = Kokkos::DefaultHostExecutionSpace;
+    using buffer_type = Kokkos::View<Scalar *, Kokkos::HostSpace>;
+
+    blocked_gemm(const std::string& name) {
+        d_mc_ = space_.add_dimension("mc", {32, 64, 96, 128, 192, 256});
+        d_nc_ = space_.add_dimension("nc", {256, 512, 1024, 2048, 4096});
+        d_kc_ = space_.add_dimension("kc", {64, 128, 256, 384, 512});
+        std::vector<int64_t> shapes(micro_tiles().size());
+        for (size_t s = 0 ; s < shapes.size() ; s++) {
+            shapes[s] = s;
+        }
+        d_micro_ = space_.add_dimension("micro_tile", shapes);
+        const size_t mc = d_mc_, nc = d_nc_, kc = d_kc_, micro = d_micro_;
+        const auto tiles = micro_tiles();
+        space_.add_constraint("micro-tiles divide the blocks", [=](const search_space::point& p) {
+            return p[mc] % tiles[p[micro]].first == 0 && p[nc] % tiles[p[micro]].second == 0;
+        });
+        // leave room in each cache for the other operands
+        const size_t l1_bytes = Impl::l1_cache_bytes();
+        space_.add_constraint("B micro-panel fits in half of L1", [=](const search_space::point& p) {
+            return size_t(p[kc] * tiles[p[micro]].second) * sizeof(Scalar) <= l1_bytes / 2;
+        });
+        const size_t l2_bytes = Impl::l2_cache_bytes();
+        space_.add_constraint("A block fits in half of L2", [=](const search_space::point& p) {
+            return size_t(p[mc] * p[kc]) * sizeof(Scalar) <= l2_bytes / 2;
+        });
+        const int64_t defaults = std::max<int64_t>(0, space_.index_of({128, 1024, 256, 3}));
+        answer_vector_.push_back(Kokkos::Tools::Experimental::make_variable_value(
+            space_.declare_output(name + "_gemm_blocking"), defaults));
+    }
+
+    // the MR x NR micro-tile shapes there are micro-kernels for
+    static std::vector<std::pair<int, int>> micro_tiles() {
+        return {{4, 4}, {4, 8}, {8, 4}, {8, 8}, {4, 16}};
+    }
+
+    // output += left * right
+    template<typename ViewType>
+    void operator()(const ViewType& left, const ViewType& right, const ViewType& output) {
+        static_assert(Kokkos::SpaceAccessibility<host_space, typename ViewType::memory_space>::accessible,
+                      "blocked_gemm runs on the host, so its views have to be host accessible");
+        Impl::tuning_scope scope(latch_, answer_vector_.data(), answer_vector_.size());
+        const search_space::point& point = space_.at(answer_vector_[0].value.int_value);
+        const int mc = point[d_mc_];
+        const int nc = point[d_nc_];
+        const int kc = point[d_kc_];
+        switch (point[d_micro_]) {
+            case 0: run<4, 4>(left, right, output, mc, nc, kc); break;
+            case 1: run<4, 8>(left, right, output, mc, nc, kc); break;
+            case 2: run<8, 4>(left, right, output, mc, nc, kc); break;
+            case 3: run<8, 8>(left, right, output, mc, nc, kc); break;
+            default: run<4, 16>(left, right, output, mc, nc, kc); break;
+        }
+    }
+
+private:
+    // grow a packing buffer, keeping it between calls
+    static void reserve(buffer_type& buffer, const size_t size, const char* label) {
+        if (buffer.extent(0) < size) {
+            buffer = buffer_type(Kokkos::view_alloc(Kokkos::WithoutInitializing, label), size);
+        }
+    }
+
+    template<int MR, int NR, typename ViewType>
+    void run(const ViewType& a, const ViewType& b, const ViewType& c,
+             const int mc, const int nc, const int kc) {
+        const int m = c.extent_int(0);
+        const int n = c.extent_int(1);
+        const int k = a.extent_int(1);
+        const int m_panels = (m + MR - 1) / MR;
+        const int m_blocks = (m + mc - 1) / mc;
+        reserve(a_pack_, size_t(m_panels) * MR * kc, "blocked gemm packed A");
+        reserve(b_pack_, size_t((nc + NR - 1) / NR) * NR * kc, "blocked gemm packed B");
+        const buffer_type a_pack = a_pack_;
+        const buffer_type b_pack = b_pack_;
+        for (int jc = 0 ; jc < n ; jc += nc) {
+            const int nb = std::min(nc, n - jc);
+            const int n_panels = (nb + NR - 1) / NR;
+            for (int pc = 0 ; pc < k ; pc += kc) {
+                const int kb = std::min(kc, k - pc);
+                Kokkos::parallel_for("blocked gemm pack B",
+                    Kokkos::RangePolicy<host_space>(0, n_panels), KOKKOS_LAMBDA(const int q) {
+                        for (int l = 0 ; l < kb ; l++) {
+                            for (int cc = 0 ; cc < NR ; cc++) {
+                                const int col = jc + q * NR + cc;
+                                b_pack((size_t(q) * kb + l) * NR + cc) = col < jc + nb ? b(pc + l, col) : Scalar(0);
+                            }
+                        }
+                    });
+                Kokkos::parallel_for("blocked gemm pack A",
+                    Kokkos::RangePolicy<host_space>(0, m_panels), KOKKOS_LAMBDA(const int p) {
+                        for (int l = 0 ; l < kb ; l++) {
+                            for (int r = 0 ; r < MR ; r++) {
+                                const int row = p * MR + r;
+                                a_pack((size_t(p) * kb + l) * MR + r) = row < m ? a(row, pc + l) : Scalar(0);
+                            }
+                        }
+                    });
+                Kokkos::parallel_for("blocked gemm",
+                    Kokkos::MDRangePolicy<host_space, Kokkos::Rank<2>>({0, 0}, {m_blocks, n_panels}),
+                    KOKKOS_LAMBDA(const int ib, const int q) {
+                        const int j0 = jc + q * NR;
+                        const int cols = Kokkos::min(NR, jc + nb - j0);
+                        const int i_end = Kokkos::min((ib + 1) * mc, m);
+                        for (int i0 = ib * mc ; i0 < i_end ; i0 += MR) {
+                            Impl::gemm_micro_kernel<MR, NR>(kb,
+                                a_pack.data() + size_t(i0 / MR) * kb * MR,
+                                b_pack.data() + size_t(q) * kb * NR,
+                                c, i0, j0, Kokkos::min(MR, m - i0), cols);
+                        }
+                    });
+            }
+        }
+        host_space().fence();
+    }
+
+    search_space space_;
+    size_t d_mc_;
+    size_t d_nc_;
+    size_t d_kc_;
+    size_t d_micro_;
+    std::vector<Kokkos::Tools::Experimental::VariableValue> answer_vector_;
+    Impl::tuning_latch latch_;
+    buffer_type a_pack_;
+    buffer_type b_pack_;
+};
+
+#endif // BLOCKEDGEMM_HPP
@@ -17,8 +17,15 @@
  * to enable you to see whether optimal tile sizes vary with View shapes
  *
  * This is basically a smoke-test, can your tool tune tile sizes
+ *
+ * deep_copy is raced with fastest_of against the blocked, recursive and
+ * SIMD variants of an in-repo transpose engine, each with a tuned block
+ * size. After the search, every variant is reported in GB/s, against a
+ * STREAM-style copy of the same data. The engine runs on the host, so GPU
+ * builds only run deep_copy.
  */
 #include <tuning_playground.hpp>
+#include <transpose.hpp>
 
 #include <chrono>
 #include <cmath> // cbrt
@@ -38,9 +45,32 @@ int main(int argc, char *argv[]) {
     left_type left("left", data_size, data_size);
     right_type right("right", data_size, data_size);
     Kokkos::Profiling::ScopedRegion region("deep_copy_2 search loop");
-    for (int i = 0 ; i < 2 * Impl::max_iterations ; i++) {
-        Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, right, left);
-    }
+    fastest_of_tuner choose_one("choose_one", 4);
+    transpose_engine engine("deep_copy_2");
+    Impl::benchmark bench("deep_copy_2");
+    bench.run(2 * Impl::max_iterations, [&](const int) {
+        Impl::on_host<right_type::memory_space>([&](auto host) {
+            if constexpr (decltype(host)::value) {
+                fastest_of(choose_one, [&]() {
+                    Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, right, left);
+                    }, [&]() {
+                    engine.blocked(right, left);
+                    }, [&]() {
+                    engine.recursive(right, left);
+                    }, [&]() {
+                    engine.simd(right, left);
+                    }
+                );
+            } else {
+                Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, right, left);
+            }
+        });
+    });
+    Impl::on_host<right_type::memory_space>([&](auto host) {
+        if constexpr (decltype(host)::value) {
+            transpose_report("deep_copy_2", engine, right, left);
+        }
+    });
   }
   Kokkos::finalize();
 }
@@ -0,0 +1,61 @@
+/**
+ * fastest_of_overhead
+ *
+ * Complexity: low
+ * Microbenchmark, not a tuning problem:
+ *
+ * Measures the per-call bookkeeping cost of fastest_of, separate from
+ * the kernels it wraps. The implementations are empty, so the time per
+ * call is the label lookup (if any) plus the tuning API calls.
+ *
+ * "label" is the string-based interface, which hashes the label on every
+ * call. "handle" is a fastest_of_tuner resolved once at the call site.
+ *
+ */
+#include <tuning_playground.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+constexpr int num_calls{1000000};
+
+template<typename Benchmark>
+double nanoseconds_per_call(Benchmark benchmark) {
+    Kokkos::Timer timer;
+    benchmark();
+    return timer.seconds() * 1.0e9 / num_calls;
+}
+
+int main(int argc, char *argv[]) {
+    Kokkos::initialize(argc, argv);
+    {
+        Kokkos::print_configuration(std::cout, false);
+        int which[3] = {0, 0, 0};
+        /* Warm up both paths, so the variable declarations are not timed */
+        fastest_of("overhead_by_label", 3,
+            [&]() { which[0]++; }, [&]() { which[1]++; }, [&]() { which[2]++; });
+        fastest_of_tuner overhead_by_handle("overhead_by_handle", 3);
+        fastest_of(overhead_by_handle,
+            [&]() { which[0]++; }, [&]() { which[1]++; }, [&]() { which[2]++; });
+
+        Kokkos::Profiling::ScopedRegion region("fastest_of_overhead loop");
+        double by_label = nanoseconds_per_call([&]() {
+            for (int i = 0 ; i < num_calls ; i++) {
+                fastest_of("overhead_by_label", 3,
+                    [&]() { which[0]++; }, [&]() { which[1]++; }, [&]() { which[2]++; });
+            }
+        });
+        double by_handle = nanoseconds_per_call([&]() {
+            for (int i = 0 ; i < num_calls ; i++) {
+                fastest_of(overhead_by_handle,
+                    [&]() { which[0]++; }, [&]() { which[1]++; }, [&]() { which[2]++; });
+            }
+        });
+        std::cout << "fastest_of overhead per call, label:  " << by_label << " ns" << std::endl;
+        std::cout << "fastest_of overhead per call, handle: " << by_handle << " ns" << std::endl;
+        std::cout << "Implementation counts: " << which[0] << ", "
+                  << which[1] << ", " << which[2] << std::endl;
+    }
+    Kokkos::finalize();
+}
@@ -0,0 +1,98 @@
+/**
+ * fastest_of_race
+ *
+ * Complexity: low
+ * Microbenchmark, not a tuning problem:
+ *
+ * Compares how many calls the built-in fastest_of bandit needs to settle
+ * on one of three out-of-place 1d stencil implementations (static,
+ * dynamic and finely chunked dynamic OpenMP schedules), when it explores
+ * them one call at a time and when fastest_of_race runs them side by side
+ * on partitioned OpenMP instances.
+ *
+ * The bandit is only used when no tuning tool answers, so run it without
+ * --apex:kokkos-tuning.
+ *
+ */
+#include <tuning_playground.hpp>
+
+#include <cstdlib>
+#include <iostream>
+
+constexpr int length{1048576}; // array length
+constexpr int max_calls{1000};
+using view_type = Kokkos::View<double *, Kokkos::HostSpace>;
+
+/* Calls fastest_of (or fastest_of_race) until the bandit has settled,
+ * and returns the number of calls that took. */
+template<typename Step>
+int calls_to_settle(fastest_of_tuner& tuner, Step step) {
+    int calls{0};
+    do {
+        step();
+        calls++;
+    } while (tuner.state_for(nullptr).bandit.exploring() && calls < max_calls);
+    return calls;
+}
+
+int main(int argc, char *argv[]) {
+    bool passed = true;
+    Kokkos::initialize(argc, argv);
+    {
+        Kokkos::print_configuration(std::cout, false);
+        view_type source("source", length);
+        view_type dest("dest", length);
+        Kokkos::deep_copy(source, 3.0);
+        /* The three candidates, each running on the given instance and
+         * writing only to the given output */
+        const auto static_stencil = [&](const Kokkos::OpenMP& instance, const view_type& out) {
+            Kokkos::parallel_for("openmp static stencil",
+                Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Static>, Kokkos::OpenMP>(
+                    instance, 1, length - 1), KOKKOS_LAMBDA(const int x) {
+                    out(x) = (source(x-1) + source(x) + source(x+1)) / 3.0;
+                });
+        };
+        const auto dynamic_stencil = [&](const Kokkos::OpenMP& instance, const view_type& out) {
+            Kokkos::parallel_for("openmp dynamic stencil",
+                Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Dynamic>, Kokkos::OpenMP>(
+                    instance, 1, length - 1), KOKKOS_LAMBDA(const int x) {
+                    out(x) = (source(x-1) + source(x) + source(x+1)) / 3.0;
+                });
+        };
+        const auto chunked_stencil = [&](const Kokkos::OpenMP& instance, const view_type& out) {
+            Kokkos::parallel_for("openmp chunked stencil",
+                Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Dynamic>, Kokkos::OpenMP>(
+                    instance, 1, length - 1, Kokkos::ChunkSize(16)), KOKKOS_LAMBDA(const int x) {
+                    out(x) = (source(x-1) + source(x) + source(x+1)) / 3.0;
+                });
+        };
+
+        Kokkos::Profiling::ScopedRegion region("fastest_of_race loop");
+        fastest_of_tuner sequential("race_sequential", 3);
+        const int sequential_calls = calls_to_settle(sequential, [&]() {
+            fastest_of(sequential,
+                [&]() { static_stencil(Kokkos::OpenMP(), dest); },
+                [&]() { dynamic_stencil(Kokkos::OpenMP(), dest); },
+                [&]() { chunked_stencil(Kokkos::OpenMP(), dest); });
+        });
+        /* Clear the sequential calls' result, so only the race can fill it in */
+        Kokkos::deep_copy(dest, -1.0);
+        fastest_of_tuner racing("race_racing", 3);
+        const int racing_calls = calls_to_settle(racing, [&]() {
+            fastest_of_race(racing, dest, static_stencil, dynamic_stencil, chunked_stencil);
+        });
+        std::cout << "Calls to settle, sequential: " << sequential_calls
+                  << ", racing: " << racing_calls << std::endl;
+
+        /* The racing result has to be the real stencil result */
+        for (int x = 1 ; x < length - 1 ; x++) {
+            if (dest(x) != 3.0) {
+                std::cerr << "Wrong result at " << x << ": " << dest(x) << std::endl;
+                passed = false;
+                break;
+            }
+        }
+    }
+    Kokkos::finalize();
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,109 @@
+/**
+ * fastest_of_threads
+ *
+ * Complexity: low
+ * Stress test, not a tuning problem:
+ *
+ * Drives fastest_of from several OpenMP host threads at once, the way an
+ * application overlaps independent kernels on partitioned execution space
+ * instances. Every host thread has its own instance and its own views, but
+ * all threads share one fastest_of_tuner handle and the label-based map.
+ *
+ * For each thread count, the throughput in fastest_of calls per second is
+ * reported, and the test checks that every call ran exactly one
+ * implementation and that every thread's stencil result is correct.
+ * Configure with -DPLAYGROUND_ENABLE_TSAN=ON to run it under ThreadSanitizer.
+ *
+ */
+#include <tuning_playground.hpp>
+#include <omp.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+constexpr int length{4096};
+constexpr int calls_per_thread{2000};
+namespace KE = Kokkos::Experimental;
+using view_type = Kokkos::View<double *, Kokkos::HostSpace>;
+
+int main(int argc, char *argv[]) {
+    bool passed = true;
+    Kokkos::initialize(argc, argv);
+    {
+        Kokkos::print_configuration(std::cout, false);
+        const int max_threads = Kokkos::OpenMP::concurrency();
+        fastest_of_tuner shared_tuner("stress_shared", 2);
+        Kokkos::Profiling::ScopedRegion region("fastest_of_threads loop");
+        for (int num_threads = 1 ; num_threads <= max_threads ; num_threads *= 2) {
+            /* One instance and one pair of views per host thread. The views
+             * hold the thread id, so a 3-point average leaves it unchanged. */
+            std::vector<int> weights(num_threads, 1);
+            auto instances = KE::partition_space(Kokkos::OpenMP(), weights);
+            std::vector<view_type> sources, dests;
+            for (int t = 0 ; t < num_threads ; t++) {
+                sources.emplace_back("source", length);
+                dests.emplace_back("dest", length);
+                Kokkos::deep_copy(sources[t], double(t));
+            }
+            std::atomic<long> implementation_calls{0};
+            Kokkos::Timer timer;
+            #pragma omp parallel num_threads(num_threads)
+            {
+                const int t = omp_get_thread_num();
+                const auto& instance = instances[t];
+                const view_type source = sources[t];
+                const view_type dest = dests[t];
+                const auto kernel = KOKKOS_LAMBDA(const int x) {
+                    dest(x) = (source(x-1) + source(x) + source(x+1)) / 3.0;
+                };
+                /* Half of the calls go through the shared handle, the others
+                 * through the label-based map, to exercise both paths. */
+                const std::string label{"stress_label_" + std::to_string(t % 4)};
+                for (int i = 0 ; i < calls_per_thread ; i++) {
+                    const auto dynamic_stencil = [&]() {
+                        implementation_calls++;
+                        Kokkos::parallel_for("openmp dynamic stress",
+                            Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Dynamic>, Kokkos::OpenMP>(
+                                instance, 1, length - 1), kernel);
+                    };
+                    const auto static_stencil = [&]() {
+                        implementation_calls++;
+                        Kokkos::parallel_for("openmp static stress",
+                            Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Static>, Kokkos::OpenMP>(
+                                instance, 1, length - 1), kernel);
+                    };
+                    if (i % 2 == 0) {
+                        fastest_of(shared_tuner, dynamic_stencil, static_stencil);
+                    } else {
+                        fastest_of(label, 2, dynamic_stencil, static_stencil);
+                    }
+                }
+                instance.fence();
+            }
+            const double elapsed = timer.seconds();
+            const long expected_calls = long(num_threads) * calls_per_thread;
+            if (implementation_calls != expected_calls) {
+                std::cerr << "Expected " << expected_calls << " implementation calls, got "
+                          << implementation_calls << std::endl;
+                passed = false;
+            }
+            for (int t = 0 ; t < num_threads ; t++) {
+                for (int x = 1 ; x < length - 1 ; x++) {
+                    if (dests[t](x) != double(t)) {
+                        std::cerr << "Thread " << t << " has a wrong result at "
+                                  << x << ": " << dests[t](x) << std::endl;
+                        passed = false;
+                        break;
+                    }
+                }
+            }
+            std::cout << "Threads: " << num_threads << ", "
+                      << expected_calls / elapsed << " calls/s" << std::endl;
+        }
+    }
+    Kokkos::finalize();
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -31,12 +31,19 @@
  * end_context(team_policy_tuner_id)
  * end_context(fastest_of_context_id)
  *
+ * The third candidate is a tiled team GEMM: each team computes a tile of
+ * the output, staging the matching blocks of the inputs in team scratch
+ * memory. Its tile edge, team size and vector length are one nested
+ * output, constrained so the tiles fit in scratch, the team's threads and
+ * vector lanes fit in a team, and every thread and vector lane has work.
+ *
  * This is an extremely difficult problem
  *
  * Note that this currently involves no features.
  *
  */
 #include <tuning_playground.hpp>
+#include <search_space.hpp>
 
 #include <chrono>
 #include <cmath> // cbrt
@@ -44,10 +51,83 @@
 #include <iostream>
 #include <random>
 #include <tuple>
+
+constexpr const int data_size = 256;
+using view_type =
+    Kokkos::View<float **, Kokkos::DefaultExecutionSpace::memory_space>;
+using tile_policy = Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace>;
+using scratch_view =
+    Kokkos::View<float **, Kokkos::DefaultExecutionSpace::scratch_memory_space,
+                 Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+
+/* The level 0 scratch a team of tiled_team_gemm asks for: three tile x
+ * tile blocks, each with room for the padding that team_scratch() may
+ * add to align it. */
+constexpr const size_t scratch_padding{64};
+size_t tile_scratch_bytes(const int64_t tile) {
+  return 3 * (scratch_view::shmem_size(tile, tile) + scratch_padding);
+}
+
+/* Each team computes one tile x tile block of the output. For every
+ * tile-deep slice of k, the team threads and vector lanes stage the
+ * matching blocks of left and right in level 0 scratch, then accumulate
+ * their product into a scratch accumulator, which is added to the output
+ * once, the way the MDRange candidate accumulates into it. */
+void tiled_team_gemm(const view_type &left, const view_type &right,
+                     const view_type &output, const int tile,
+                     const int team_size, const int vector_length) {
+  using team_member = tile_policy::member_type;
+  const int tiles = data_size / tile;
+  const auto policy =
+      tile_policy(tiles * tiles, team_size, vector_length)
+          .set_scratch_size(
+              0, Kokkos::PerTeam(tile_scratch_bytes(tile)));
+  Kokkos::parallel_for(
+      "tiled_team_gemm", policy, KOKKOS_LAMBDA(const team_member &member) {
+        const int x0 = (member.league_rank() / tiles) * tile;
+        const int y0 = (member.league_rank() % tiles) * tile;
+        scratch_view left_block(member.team_scratch(0), tile, tile);
+        scratch_view right_block(member.team_scratch(0), tile, tile);
+        scratch_view sum(member.team_scratch(0), tile, tile);
+        Kokkos::parallel_for(
+            Kokkos::TeamThreadRange(member, tile), [&](const int i) {
+              Kokkos::parallel_for(
+                  Kokkos::ThreadVectorRange(member, tile),
+                  [&](const int j) { sum(i, j) = 0; });
+            });
+        for (int z0 = 0; z0 < data_size; z0 += tile) {
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(member, tile), [&](const int i) {
+                Kokkos::parallel_for(
+                    Kokkos::ThreadVectorRange(member, tile), [&](const int j) {
+                      left_block(i, j) = left(x0 + i, z0 + j);
+                      right_block(i, j) = right(z0 + i, y0 + j);
+                    });
+              });
+          member.team_barrier();
+          Kokkos::parallel_for(
+              Kokkos::TeamThreadRange(member, tile), [&](const int i) {
+                Kokkos::parallel_for(
+                    Kokkos::ThreadVectorRange(member, tile), [&](const int j) {
+                      float partial = 0;
+                      for (int z = 0; z < tile; ++z) {
+                        partial += left_block(i, z) * right_block(z, j);
+                      }
+                      sum(i, j) += partial;
+                    });
+              });
+          member.team_barrier();
+        }
+        Kokkos::parallel_for(
+            Kokkos::TeamThreadRange(member, tile), [&](const int i) {
+              Kokkos::parallel_for(
+                  Kokkos::ThreadVectorRange(member, tile),
+                  [&](const int j) { output(x0 + i, y0 + j) += sum(i, j); });
+            });
+      });
+}
+
 int main(int argc, char *argv[]) {
-  constexpr const int data_size = 256;
-  using view_type =
-      Kokkos::View<float **, Kokkos::DefaultExecutionSpace::memory_space>;
 
   Kokkos::initialize(argc, argv);
   {
@@ -56,10 +136,50 @@ int main(int argc, char *argv[]) {
     view_type right("right_inp", data_size, data_size);
     view_type output("output", data_size, data_size);
 
+    /* The tile edge, team size and vector length of the tiled team gemm
+     * are tuned as one space, because they constrain each other. */
+    const auto probe = KOKKOS_LAMBDA(const tile_policy::member_type &){};
+    const int64_t team_size_max =
+        tile_policy(1, 1).team_size_max(probe, Kokkos::ParallelForTag());
+    search_space space;
+    const size_t d_tile = space.add_dimension("tile", {8, 16, 32, 64});
+    const size_t d_team =
+        space.add_dimension("team_size", powersOfTwoUpTo(team_size_max));
+    const size_t d_vector = space.add_dimension(
+        "vector_length",
+        powersOfTwoUpTo(std::min<int64_t>(32, tile_policy::vector_length_max())));
+    space.add_constraint(
+        "tiles fit in scratch", [=](const search_space::point &p) {
+          return tile_scratch_bytes(p[d_tile]) <=
+                 size_t(tile_policy::scratch_size_max(0));
+        });
+    // team_size_max was taken with one vector lane per thread
+    space.add_constraint(
+        "team fits with its vector lanes", [=](const search_space::point &p) {
+          return p[d_team] * p[d_vector] <= team_size_max;
+        });
+    space.add_constraint(
+        "every thread has a row", [=](const search_space::point &p) {
+          return p[d_team] <= p[d_tile];
+        });
+    space.add_constraint(
+        "every vector lane has a column", [=](const search_space::point &p) {
+          return p[d_vector] <= p[d_tile];
+        });
+    std::vector<Kokkos::Tools::Experimental::VariableValue> tile_answer{
+        Kokkos::Tools::Experimental::make_variable_value(
+            space.declare_output("tiled_team_gemm_shape"),
+            std::max<int64_t>(0, space.index_of({32, 1, 1})))};
+
+    // latches the tile shape once it has converged
+    Impl::tuning_latch tile_latch;
+
+    fastest_of_tuner bad_gemms("bad_gemms", 3);
     Kokkos::Profiling::ScopedRegion region("idk_jmm search loop");
-    for (int i = 0 ; i < Impl::max_iterations ; i++) {
+    Impl::benchmark bench("idk_jmm");
+    bench.run(Impl::max_iterations, [&](const int) {
         fastest_of(
-            "bad_gemms", 2,
+            bad_gemms,
             [&]() {
               //std::cout << i << " Doing team gemm..." << std::endl;
               using team_policy =
@@ -95,8 +215,17 @@ int main(int argc, char *argv[]) {
                       output(x, y) += left(x, z) * right(z, y);
                     }
                   });
+            },
+            [&]() {
+              // the nested context for the tile shape, skipped once latched
+              Impl::tuning_scope scope(tile_latch, tile_answer.data(),
+                                       tile_answer.size());
+              const search_space::point &shape =
+                  space.at(tile_answer[0].value.int_value);
+              tiled_team_gemm(left, right, output, shape[d_tile],
+                              shape[d_team], shape[d_vector]);
             });
-    }
+    });
   }
   Kokkos::finalize();
 }
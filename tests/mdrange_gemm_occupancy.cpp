@@ -35,8 +35,14 @@
  *
  * Note that this currently involves no features.
  *
+ * The naive kernel is raced with fastest_of against a BLIS-style blocked
+ * GEMM engine (blocked_gemm.hpp), whose MC/NC/KC cache blocking and
+ * MR x NR micro-tile are tuned in a nested context. The engine runs on
+ * the host, so GPU builds only run the naive kernel.
+ *
  */
 #include <tuning_playground.hpp>
+#include <blocked_gemm.hpp>
 
 #include <chrono>
 #include <cmath> // cbrt
@@ -57,7 +63,12 @@ int main(int argc, char *argv[]) {
     view_type output("output", data_size, data_size);
 
     Kokkos::Profiling::ScopedRegion region("mdrange_gemm_occupancy search loop");
-    for (int i = 0 ; i < Impl::max_iterations ; i++) {
+    /* The blocked engine runs on the host, so it is only raced when the
+     * matrices are in host accessible memory. */
+    fastest_of_tuner choose_one("choose_one", 2);
+    blocked_gemm<float> engine("mdrange_gemm_occupancy");
+    const auto naive = [&]() {
+      /* Option 1: naive kernel, Kokkos tunes the occupancy */
       Kokkos::MDRangePolicy<Kokkos::DefaultExecutionSpace,
                             Kokkos::Rank<2>> p(
           {0, 0}, {data_size, data_size});
@@ -71,7 +82,20 @@ int main(int argc, char *argv[]) {
             }
           }
       );
-    }
+    };
+    Impl::benchmark bench("mdrange_gemm_occupancy");
+    bench.run(Impl::max_iterations, [&](const int) {
+      Impl::on_host<view_type::memory_space>([&](auto host) {
+        if constexpr (decltype(host)::value) {
+          fastest_of(choose_one, naive, [&]() {
+            /* Option 2: packed, cache blocked engine with a register micro-kernel */
+            engine(left, right, output);
+          });
+        } else {
+          naive();
+        }
+      });
+    });
   }
   Kokkos::finalize();
 }
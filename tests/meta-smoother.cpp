@@ -311,14 +311,16 @@ int main(int argc, char *argv[]) {
     Kokkos::initialize(argc, argv);
     {
         Kokkos::print_configuration(std::cout, false);
+        fastest_of_tuner meta_smoother("meta-smoother", 3);
         Kokkos::Profiling::ScopedRegion region("meta smoother search loop");
-        for (int i = 0 ; i < 1000 ; i++) {
-            fastest_of("meta-smoother", 3,
+        Impl::benchmark bench("meta-smoother");
+        bench.run(1000, [&](const int) {
+            fastest_of(meta_smoother,
                 [&]() { metasmoother::doChebyshev(); },
                 [&]() { metasmoother::MultiThreadedGaussSeidel(); },
                 [&]() { metasmoother::TwoStageGaussSeidel(); }
             );
-        }
+        });
     }
     Kokkos::finalize();
 }
@@ -1,4 +1,7 @@
 #include <tuning_playground.hpp>
+#include <search_space.hpp>
+#include <numa_placement.hpp>
+#include <random_data.hpp>
 #include <omp.h>
 
 #include <chrono>
@@ -17,6 +20,8 @@ const int P=128;
 const std::string mm2D{"mm2D"};
 enum schedulers{StaticSchedule, DynamicSchedule};
 static const std::string scheduleNames[] = {"static", "dynamic"};
+enum formulations{KInner, OuterProduct, PackedPanels};
+static const std::string formulationNames[] = {"k-inner", "outer-product", "packed"};
 
 using matrix2d = Kokkos::View<int **, Kokkos::OpenMP::memory_space>;
 namespace KTE = Kokkos::Tools::Experimental;
@@ -24,69 +29,156 @@ namespace KE = Kokkos::Experimental;
 constexpr int lowerBound{100};
 constexpr int upperBound{999};
 
-// Helper function to generate tile sizes
-std::vector<int64_t> factorsOf(const int &size){
-    std::vector<int64_t> factors;
-    for(int i=1; i<size; i++){
-        if(size % i == 0){
-            factors.push_back(i);
+// the product of a and b, computed serially, to check the tuned runs against
+void referenceProduct(const matrix2d& a, const matrix2d& b, matrix2d& c) {
+    for(int i=0; i<M; i++){
+        for(int j=0; j<P; j++){
+            int sum = 0;
+            for(int k=0; k<N; k++){
+                sum += a(i,k) * b(k,j);
+            }
+            c(i,j) = sum;
         }
     }
-    return factors;
 }
 
-// Helper function to generate thread counts
-std::vector<int64_t> makeRange(const int &size){
-    std::vector<int64_t> range;
-    for(int i=2; i<=size; i+=2){
-        range.push_back(i);
+// helper function for checking a result, returns the number of wrong entries
+int64_t countMismatches(const matrix2d& result, const matrix2d& expected) {
+    int64_t wrong = 0;
+    for(int i=0; i<M; i++){
+        for(int j=0; j<P; j++){
+            if (result(i,j) != expected(i,j)) {
+                if (wrong == 0) {
+                    std::cerr << "Wrong result at (" << i << "," << j << "): "
+                              << result(i,j) << " instead of " << expected(i,j) << std::endl;
+                }
+                wrong++;
+            }
+        }
     }
-    return range;
+    return wrong;
 }
 
-// helper function for human output
-void reportOptions(std::vector<int64_t>& candidates,
-    std::string name, size_t size) {
-    std::cout<<"Tiling options for " << name << "="<<size<<std::endl;
-    for(auto &i : candidates){ std::cout<<i<<", "; }
-    std::cout<<std::endl;
+/* Each work item owns a ti x tj block of the result and reduces over all
+ * of k for every entry of it, so no two work items write the same entry.
+ * Tile sizes of 0 let Kokkos pick the tiling. */
+template<typename Schedule>
+void kInnerProduct(const Kokkos::OpenMP& instance, const matrix2d& a, const matrix2d& b,
+                   const matrix2d& c, const int ti, const int tj) {
+    Kokkos::MDRangePolicy<Kokkos::OpenMP, Kokkos::Schedule<Schedule>, Kokkos::Rank<2>>
+        policy(instance, {0,0}, {M,P}, {ti,tj});
+    Kokkos::parallel_for(mm2D, policy, KOKKOS_LAMBDA(int i, int j){
+        int sum = 0;
+        for(int k=0; k<N; k++){
+            sum += a(i,k) * b(k,j);
+        }
+        c(i,j) = sum;
+    });
 }
 
-// helper function for matrix init
-void initArray(matrix2d& ar, size_t d1, size_t d2) {
-    for(size_t i=0; i<d1; i++){
-        for(size_t j=0; j<d2; j++){
-                ar(i,j)=(rand() % (upperBound - lowerBound + 1)) + lowerBound;
+/* Each single-thread team owns a ti x tj block of the result and
+ * accumulates the outer products of a's columns and b's rows into a
+ * private accumulator in scratch memory, then writes the block once. */
+template<typename Schedule>
+void outerProduct(const Kokkos::OpenMP& instance, const matrix2d& a, const matrix2d& b,
+                  const matrix2d& c, const int ti, const int tj) {
+    using policy_type = Kokkos::TeamPolicy<Kokkos::OpenMP, Kokkos::Schedule<Schedule>>;
+    using member_type = typename policy_type::member_type;
+    using scratch_view = Kokkos::View<int **, Kokkos::OpenMP::scratch_memory_space,
+                                      Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+    const int tiles_j = P / tj;
+    const auto policy = policy_type(instance, (M / ti) * tiles_j, 1).set_scratch_size(1,
+        Kokkos::PerTeam(scratch_view::shmem_size(ti, tj)));
+    Kokkos::parallel_for(mm2D, policy, KOKKOS_LAMBDA(const member_type& member){
+        const int i0 = (member.league_rank() / tiles_j) * ti;
+        const int j0 = (member.league_rank() % tiles_j) * tj;
+        scratch_view acc(member.team_scratch(1), ti, tj);
+        for(int i=0; i<ti; i++){
+            for(int j=0; j<tj; j++){
+                acc(i,j) = 0;
+            }
         }
-    }
+        for(int k=0; k<N; k++){
+            for(int i=0; i<ti; i++){
+                const int aik = a(i0+i,k);
+                for(int j=0; j<tj; j++){
+                    acc(i,j) += aik * b(k,j0+j);
+                }
+            }
+        }
+        for(int i=0; i<ti; i++){
+            for(int j=0; j<tj; j++){
+                c(i0+i,j0+j) = acc(i,j);
+            }
+        }
+    });
 }
 
-// helper function for matrix init
-void zeroArray(matrix2d& ar, size_t d1, size_t d2) {
-    for(size_t i=0; i<d1; i++){
-        for(size_t j=0; j<d2; j++){
-                ar(i,j)=0.0;
+/* Like outerProduct, but k is blocked by tk, and for every k block the
+ * ti x tk panel of a and the tk x tj panel of b are first packed into
+ * contiguous scratch buffers, in the order the inner loops read them. */
+template<typename Schedule>
+void packedPanels(const Kokkos::OpenMP& instance, const matrix2d& a, const matrix2d& b,
+                  const matrix2d& c, const int ti, const int tj, const int tk) {
+    using policy_type = Kokkos::TeamPolicy<Kokkos::OpenMP, Kokkos::Schedule<Schedule>>;
+    using member_type = typename policy_type::member_type;
+    using scratch_view = Kokkos::View<int **, Kokkos::OpenMP::scratch_memory_space,
+                                      Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+    const int tiles_j = P / tj;
+    const auto policy = policy_type(instance, (M / ti) * tiles_j, 1).set_scratch_size(1,
+        Kokkos::PerTeam(scratch_view::shmem_size(ti, tj) + scratch_view::shmem_size(tk, ti) +
+                        scratch_view::shmem_size(tk, tj)));
+    Kokkos::parallel_for(mm2D, policy, KOKKOS_LAMBDA(const member_type& member){
+        const int i0 = (member.league_rank() / tiles_j) * ti;
+        const int j0 = (member.league_rank() % tiles_j) * tj;
+        scratch_view acc(member.team_scratch(1), ti, tj);
+        // a's panel is stored transposed, so each k reads a contiguous row
+        scratch_view a_panel(member.team_scratch(1), tk, ti);
+        scratch_view b_panel(member.team_scratch(1), tk, tj);
+        for(int i=0; i<ti; i++){
+            for(int j=0; j<tj; j++){
+                acc(i,j) = 0;
+            }
         }
-    }
+        for(int k0=0; k0<N; k0+=tk){
+            for(int i=0; i<ti; i++){
+                for(int k=0; k<tk; k++){
+                    a_panel(k,i) = a(i0+i,k0+k);
+                }
+            }
+            for(int k=0; k<tk; k++){
+                for(int j=0; j<tj; j++){
+                    b_panel(k,j) = b(k0+k,j0+j);
+                }
+            }
+            for(int k=0; k<tk; k++){
+                for(int i=0; i<ti; i++){
+                    const int aik = a_panel(k,i);
+                    for(int j=0; j<tj; j++){
+                        acc(i,j) += aik * b_panel(k,j);
+                    }
+                }
+            }
+        }
+        for(int i=0; i<ti; i++){
+            for(int j=0; j<tj; j++){
+                c(i0+i,j0+j) = acc(i,j);
+            }
+        }
+    });
 }
 
-// helper function for declaring output tiling variables
-size_t declareOutputTileSize(std::string name, std::string varname, size_t limit) {
-    size_t out_value_id;
-    // create a vector of potential values
-    std::vector<int64_t> candidates = factorsOf(limit);
-    reportOptions(candidates, name, limit);
-    // create our variable object
-    KTE::VariableInfo out_info;
-    // set the variable details
-    out_info.type = KTE::ValueType::kokkos_value_int64;
-    out_info.category = KTE::StatisticalCategory::kokkos_value_categorical;
-    out_info.valueQuantity = KTE::CandidateValueType::kokkos_value_set;
-    out_info.candidates = KTE::make_candidate_set(candidates.size(),candidates.data());
-    // declare the variable
-    out_value_id = KTE::declare_output_type(varname,out_info);
-    // return the id
-    return out_value_id;
+// run the chosen formulation with the chosen schedule
+template<typename Schedule>
+void gemm(const int formulation, const Kokkos::OpenMP& instance, const matrix2d& a,
+          const matrix2d& b, const matrix2d& c, const int ti, const int tj, const int tk) {
+    if (formulation == KInner) {
+        kInnerProduct<Schedule>(instance, a, b, c, ti, tj);
+    } else if (formulation == OuterProduct) {
+        outerProduct<Schedule>(instance, a, b, c, ti, tj);
+    } else {
+        packedPanels<Schedule>(instance, a, b, c, ti, tj, tk);
+    }
 }
 
 // helper function for declaring input size variables
@@ -107,42 +199,8 @@ size_t declareInputViewSize(std::string varname, int64_t size) {
     return in_value_id;
 }
 
-// helper function for declaring scheduler variable
-size_t declareOutputSchedules(std::string varname) {
-    // create a vector of potential values
-    std::vector<int64_t> candidates_schedule = {StaticSchedule,DynamicSchedule};
-    // create our variable object
-    KTE::VariableInfo schedule_out_info;
-    // set the variable details
-    schedule_out_info.type = KTE::ValueType::kokkos_value_int64;
-    schedule_out_info.category = KTE::StatisticalCategory::kokkos_value_categorical;
-    schedule_out_info.valueQuantity = KTE::CandidateValueType::kokkos_value_set;
-    schedule_out_info.candidates = KTE::make_candidate_set(candidates_schedule.size(),candidates_schedule.data());
-    // declare the variable
-    size_t schedule_out_value_id = KTE::declare_output_type(varname,schedule_out_info);
-    // return the id
-    return schedule_out_value_id;
-}
-
-// helper function for declaring output tread count variable
-size_t declareOutputThreadCount(std::string varname, size_t limit) {
-    size_t out_value_id;
-    // create a vector of potential values
-    std::vector<int64_t> candidates = makeRange(limit);
-    // create our variable object
-    KTE::VariableInfo out_info;
-    // set the variable details
-    out_info.type = KTE::ValueType::kokkos_value_int64;
-    out_info.category = KTE::StatisticalCategory::kokkos_value_categorical;
-    out_info.valueQuantity = KTE::CandidateValueType::kokkos_value_set;
-    out_info.candidates = KTE::make_candidate_set(candidates.size(),candidates.data());
-    // declare the variable
-    out_value_id = KTE::declare_output_type(varname,out_info);
-    // return the id
-    return out_value_id;
-}
-
 int main(int argc, char *argv[]){
+    bool passed = true;
     // surely there is a way to get this from Kokkos?
     bool tuning = false;
     char * tmp{getenv("APEX_KOKKOS_TUNING")};
@@ -157,14 +215,20 @@ int main(int argc, char *argv[]){
     {
         // print the Kokkos configuration
         Kokkos::print_configuration(std::cout, false);
-        // seed the random number generator, sure
-        srand(time(0));
 
-        /* Declare/Init re,ar1,ar2 */
-        matrix2d ar1("array1",M,N), ar2("array2",N,P), re("Result",M,P);
-        initArray(ar1, M, N);
-        initArray(ar2, N, P);
-        zeroArray(re, M, P);
+        /* Declare/Init re,ar1,ar2, and the expected result */
+        matrix2d ar1(Kokkos::view_alloc(Kokkos::WithoutInitializing, "array1"),M,N),
+                 ar2(Kokkos::view_alloc(Kokkos::WithoutInitializing, "array2"),N,P),
+                 re(Kokkos::view_alloc(Kokkos::WithoutInitializing, "Result"),M,P),
+                 expected(Kokkos::view_alloc(Kokkos::WithoutInitializing, "Expected"),M,P);
+        // touch the pages first from the threads that will compute on them
+        for (const matrix2d& m : {ar1, ar2, re, expected}) {
+            first_touch(m);
+        }
+        fill_uniform(ar1, lowerBound, upperBound);
+        fill_uniform(ar2, lowerBound, upperBound);
+        Kokkos::deep_copy(re, 0);
+        referenceProduct(ar1, ar2, expected);
 
         // Context variable setup - needed to generate a unique context hash for tuning.
         // Declare the variables and store the variable IDs
@@ -184,124 +248,112 @@ int main(int argc, char *argv[]){
             KTE::make_variable_value(id[4], int64_t(P))
         };
 
-        // Declare the variables and store the variable IDs
-        size_t out_value_id[5];
-
-        // Tuning tile size - setup
-        out_value_id[0] = declareOutputTileSize("M", "ti_out", M);
-        out_value_id[1] = declareOutputTileSize("N", "tj_out", N);
-        out_value_id[2] = declareOutputTileSize("P", "tk_out", P);
-        // Tuning tile size - end setup
-
-        // scheduling policy - setup
-        out_value_id[3] = declareOutputSchedules("schedule_out");
-        // scheduling policy - end setup
-
-        // thread count - setup
+        /* The formulation, tiling, schedule and thread count are tuned as one
+         * joint space, so the tuner only sees the combinations that make sense.
+         * ti and tj block the result, tk blocks the reduction. */
         int64_t max_threads = std::min(std::thread::hardware_concurrency(),
                 (unsigned int)(Kokkos::OpenMP::concurrency()));
-        out_value_id[4] = declareOutputThreadCount("thread_count", max_threads);
-        // thread count - end setup
-
-        //The second argument to make_varaible_value might be a default value
+        search_space space;
+        const size_t d_formulation = space.add_dimension("formulation",
+            {KInner, OuterProduct, PackedPanels});
+        const size_t d_ti = space.add_dimension("ti", divisorsOf(M));
+        const size_t d_tj = space.add_dimension("tj", divisorsOf(P));
+        const size_t d_tk = space.add_dimension("tk", divisorsOf(N));
+        const size_t d_schedule = space.add_dimension("schedule", {StaticSchedule, DynamicSchedule});
+        // a log-spaced subset of the thread counts keeps this dimension
+        // small on nodes with many cores
+        const size_t d_threads = space.add_dimension("threads",
+            log_spaced(threadCountsUpTo(max_threads), 6));
+        // only the packed formulation blocks the reduction
+        space.add_constraint("only packed panels block k", [=](const search_space::point& p) {
+            return p[d_formulation] == PackedPanels || p[d_tk] == N;
+        });
+        // the rows of a, columns of b and block of the result a tile works on
+        const size_t l2_bytes = Impl::l2_cache_bytes();
+        space.add_constraint("tile fits in L2", [=](const search_space::point& p) {
+            const int64_t depth = p[d_formulation] == PackedPanels ? p[d_tk] : N;
+            return size_t(p[d_ti] * depth + depth * p[d_tj] + p[d_ti] * p[d_tj]) *
+                sizeof(matrix2d::value_type) <= l2_bytes;
+        });
+        // smaller tiles spend more time scheduling and packing than computing
+        space.add_constraint("tiles are at least 16 on a side", [=](const search_space::point& p) {
+            return p[d_ti] >= 16 && p[d_tj] >= 16 && p[d_tk] >= 16;
+        });
+        // every thread gets the same number of result tiles
+        space.add_constraint("tiles divide among threads", [=](const search_space::point& p) {
+            const int64_t tiles = (M / p[d_ti]) * (P / p[d_tj]);
+            return tiles >= p[d_threads] && tiles % p[d_threads] == 0;
+        });
+        size_t out_value_id = space.declare_output("mm2d_tiling_space");
+        // the default answer is the first feasible point
         std::vector<KTE::VariableValue> answer_vector{
-            KTE::make_variable_value(out_value_id[0], int64_t(1)),
-            KTE::make_variable_value(out_value_id[1], int64_t(1)),
-            KTE::make_variable_value(out_value_id[2], int64_t(1)),
-            KTE::make_variable_value(out_value_id[3], int64_t(StaticSchedule)),
-            KTE::make_variable_value(out_value_id[4], int64_t(max_threads))
-        };
-
-        /* Declare the kernel that does the work */
-        const auto kernel = KOKKOS_LAMBDA(int i, int j, int k){
-            re(i,j) += ar1(i,j) * ar2(j,k);
+            KTE::make_variable_value(out_value_id, int64_t(0))
         };
 
+        // latches the tuning decision once it has converged
+        Impl::tuning_latch latch;
         Kokkos::Profiling::ScopedRegion region("mm2d_tiling search loop");
         /* Iterate max_iterations times, so that we can explore the search
-         * space. Not all searches will converge - we have a large space!
-         * It's likely that exhaustive search will fail to converge. */
-        for (int i = 0 ; i < Impl::max_iterations ; i++) {
-            // request a context id
-            size_t context = KTE::get_new_context_id();
-            // start the context
-            KTE::begin_context(context);
-
-            // set the input values for the context
-            KTE::set_input_values(context, input_vector.size(), input_vector.data());
-            // request new output values for the context
-            KTE::request_output_values(context, answer_vector.size(), answer_vector.data());
+         * space. The constraints keep it small enough for exhaustive search.
+         * Every run is checked against the reference, outside the tuning
+         * context, so a configuration can't win by computing the wrong thing. */
+        Impl::benchmark bench("mm2d_tiling");
+        bench.run(Impl::max_iterations, [&](const int) {
+            // open a context with the input values, and request new output values
+            // for it, unless the latched ones are to be reused
+            Impl::tuning_scope scope(latch);
+            scope.request(answer_vector.data(), answer_vector.size(),
+                input_vector.data(), input_vector.size());
 
-            // get the tiling factors
-            int ti,tj,tk;
-            ti = answer_vector[0].value.int_value;
-            tj = answer_vector[1].value.int_value;
-            tk = answer_vector[2].value.int_value;
-            // get our schedule and thread count
-            int scheduleType = answer_vector[3].value.int_value;
-            // there's probably a better way to set the thread count?
-            int num_threads = answer_vector[4].value.int_value;
-            int leftover_threads = max_threads - answer_vector[4].value.int_value;
+            // get the formulation, tiling factors, schedule and thread count
+            const search_space::point& point = space.at(answer_vector[0].value.int_value);
+            int formulation = point[d_formulation];
+            int ti = point[d_ti];
+            int tj = point[d_tj];
+            int tk = point[d_tk];
+            int scheduleType = point[d_schedule];
+            int num_threads = point[d_threads];
+            if (tuning) {
+                bench.configuration("formulation=" + formulationNames[formulation] +
+                    ",tiling=" + std::to_string(ti) + "x" +
+                    std::to_string(tj) + "x" + std::to_string(tk) +
+                    ",schedule=" + scheduleNames[scheduleType] +
+                    ",threads=" + std::to_string(num_threads));
+            }
 
             // no tuning?
             if (!tuning) {
-                // default scheduling policy, default tiling
-                Kokkos::MDRangePolicy<Kokkos::OpenMP,
-                    Kokkos::Rank<3>> default_policy({0,0,0},{M,N,P});
-                Kokkos::parallel_for(
-                        mm2D, default_policy, KOKKOS_LAMBDA(int i, int j, int k){
-                        re(i,j) += ar1(i,j) * ar2(j,k);
-                        }
-                        );
-            // use static schedule?
-            } else if (scheduleType == StaticSchedule) {
+                // default formulation, scheduling policy and tiling
+                kInnerProduct<Kokkos::Static>(Kokkos::OpenMP(), ar1, ar2, re, 0, 0);
+                Kokkos::fence();
+            } else {
                 // Report the tuning, if desired
+                std::cout << "Formulation: " << formulationNames[formulation] << ", ";
                 std::cout << "Tiling: [" << ti << "," << tj << "," << tk << "], ";
                 std::cout << "Schedule: " << scheduleNames[scheduleType] << ", ";
-                std::cout << "Threads: " << answer_vector[4].value.int_value;
+                std::cout << "Threads: " << num_threads;
                 std::cout << std::endl;
 
-                // if using max threads, no need to partition
-                if (num_threads == max_threads) {
-                    // static scheduling, tuned tiling
-                    Kokkos::MDRangePolicy<Kokkos::OpenMP,
-                        Kokkos::Schedule<Kokkos::Static>,
-                        Kokkos::Rank<3>> static_policy({0,0,0},{M,N,P},{ti,tj,tk});
-                    Kokkos::parallel_for(mm2D, static_policy, kernel);
+                // if using max threads, no need to partition, otherwise use a
+                // pooled partition, so we can tune the number of threads
+                const Kokkos::OpenMP instance = num_threads == max_threads ?
+                    Kokkos::OpenMP() : Impl::openmp_instances().with_threads(num_threads);
+                if (scheduleType == StaticSchedule) {
+                    gemm<Kokkos::Static>(formulation, instance, ar1, ar2, re, ti, tj, tk);
                 } else {
-                    // partition the space so we can tune the number of threads
-                    auto instances = KE::partition_space(Kokkos::OpenMP(),
-                        num_threads, leftover_threads);
-                    // static scheduling, tuned tiling
-                    Kokkos::MDRangePolicy<Kokkos::OpenMP,
-                        Kokkos::Schedule<Kokkos::Static>,
-                        Kokkos::Rank<3>> static_policy(instances[0],{0,0,0},{M,N,P},{ti,tj,tk});
-                    Kokkos::parallel_for(mm2D, static_policy, kernel);
-                }
-            } else {
-                // if using max threads, no need to partition
-                if (num_threads == max_threads) {
-                    // dynamic scheduling, tuned tiling
-                    Kokkos::MDRangePolicy<Kokkos::OpenMP,
-                        Kokkos::Schedule<Kokkos::Dynamic>,
-                        Kokkos::Rank<3>> dynamic_policy({0,0,0},{M,N,P},{ti,tj,tk});
-                    Kokkos::parallel_for(
-                            mm2D, dynamic_policy, kernel);
-                } else {
-                    // partition the space so we can tune the number of threads
-                    auto instances = KE::partition_space(Kokkos::OpenMP(),
-                        num_threads, leftover_threads);
-                    // dynamic scheduling, tuned tiling
-                    Kokkos::MDRangePolicy<Kokkos::OpenMP,
-                        Kokkos::Schedule<Kokkos::Dynamic>,
-                        Kokkos::Rank<3>> dynamic_policy(instances[0],{0,0,0},{M,N,P},{ti,tj,tk});
-                    Kokkos::parallel_for(
-                            mm2D, dynamic_policy, kernel);
+                    gemm<Kokkos::Dynamic>(formulation, instance, ar1, ar2, re, ti, tj, tk);
                 }
+                instance.fence();
             }
             // end the context
-            KTE::end_context(context);
-        }
+            scope.close();
+            // check the result, and clear it for the next run
+            if (countMismatches(re, expected) > 0) {
+                passed = false;
+            }
+            Kokkos::deep_copy(re, 0);
+        });
     }
     Kokkos::finalize();
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
 }
\ No newline at end of file
@@ -0,0 +1,221 @@
+#ifndef NUMAPLACEMENT_HPP
+#define NUMAPLACEMENT_HPP
+
+#include<tuning_playground.hpp>
+#include<cstring>
+#include<fstream>
+#include<functional>
+#include<iostream>
+#include<sstream>
+#include<string>
+#include<type_traits>
+#include<vector>
+#include<unistd.h>
+#if defined(__linux__)
+#include<sys/syscall.h>
+#endif
+
+namespace Impl {
+
+/* The NUMA nodes that are online, from /sys, or just node 0 if that
+ * can't be read. */
+inline const std::vector<int>& numa_nodes() {
+    static const std::vector<int> nodes = [](){
+        std::vector<int> online;
+        std::ifstream file("/sys/devices/system/node/online");
+        std::string list;
+        if (file >> list) {
+            // a list of ranges, like "0-1" or "0,2-3"
+            std::stringstream ranges(list);
+            std::string range;
+            while (std::getline(ranges, range, ',')) {
+                const size_t dash = range.find('-');
+                const int first = std::stoi(range.substr(0, dash));
+                const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int node = first ; node <= last ; node++) {
+                    online.push_back(node);
+                }
+            }
+        }
+        if (online.empty()) {
+            online.push_back(0);
+        }
+        return online;
+    }();
+    return nodes;
+}
+
+// the memory policies of mbind(2), without a dependency on libnuma
+enum memory_policy { mpol_default = 0, mpol_bind = 2, mpol_interleave = 3, mpol_local = 4 };
+constexpr unsigned mpol_mf_move{1 << 1};
+
+/* Sets the memory policy of the whole pages in [begin, end) to mode on
+ * the given nodes, and moves the pages already there to follow it. Pages
+ * that [begin, end) only covers in part may hold other allocations, and
+ * are left alone. Returns false if the pages could not be moved, or not
+ * on this system. */
+inline bool move_pages_to(char* begin, char* end, const int mode, const std::vector<int>& nodes) {
+#if defined(__linux__) && defined(SYS_mbind)
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    const uintptr_t first = (reinterpret_cast<uintptr_t>(begin) + page - 1) / page * page;
+    const uintptr_t last = reinterpret_cast<uintptr_t>(end) / page * page;
+    if (last <= first) {
+        return true;
+    }
+    constexpr int bits{8 * sizeof(unsigned long)};
+    std::vector<unsigned long> mask;
+    for (const int node : nodes) {
+        if (mask.size() <= size_t(node / bits)) {
+            mask.resize(node / bits + 1, 0);
+        }
+        mask[node / bits] |= 1ul << (node % bits);
+    }
+    return syscall(SYS_mbind, first, last - first, mode, mask.empty() ? nullptr : mask.data(),
+                   mask.empty() ? 0 : mask.size() * bits + 1, mpol_mf_move) == 0;
+#else
+    (void)begin; (void)end; (void)mode; (void)nodes;
+    return false;
+#endif
+}
+
+} // namespace Impl
+
+/* Touches every row of a View allocated WithoutInitializing for the first
+ * time, in parallel, with the static schedule over the leading dimension
+ * that the compute kernels use. Under the first-touch policy each page
+ * then lands on the NUMA node of the thread that will compute on it,
+ * instead of all of them on the node of the thread that fills the View.
+ * Values are written afterwards, and don't move the pages. */
+template<typename ViewType>
+void first_touch(const ViewType& view) {
+    static_assert(ViewType::rank == 1 || std::is_same<typename ViewType::array_layout, Kokkos::LayoutRight>::value,
+                  "first_touch splits the View into rows, which have to be contiguous");
+    static_assert(Impl::host_accessible<typename ViewType::memory_space>,
+                  "first_touch places pages for host threads");
+    using value_type = typename ViewType::non_const_value_type;
+    using execution_space = Kokkos::DefaultHostExecutionSpace;
+    const size_t row_bytes = view.span() / std::max<size_t>(1, view.extent(0)) * sizeof(value_type);
+    char* const data = reinterpret_cast<char*>(view.data());
+    Kokkos::parallel_for("first touch", Kokkos::RangePolicy<execution_space,
+        Kokkos::Schedule<Kokkos::Static>>(0, view.extent(0)),
+        [=](const size_t row) { std::memset(data + row * row_bytes, 0, row_bytes); });
+    execution_space().fence();
+}
+
+/* Where the pages of some Views live on a NUMA system, as a tuning output:
+ *
+ *  - first_touch: each thread's share of a View on the thread's own node,
+ *    which is where first_touch() puts it
+ *  - interleaved: round-robin over all the nodes, page by page
+ *  - socket_local: one contiguous block of a View per node, in order
+ *
+ * The policy is requested in a context of its own. Moving pages inside
+ * that context would time the move instead of the kernel, so each tracked
+ * View gets a copy per other policy when it is tracked, placed with
+ * mbind(2) up front, and a change of policy only points the View handles
+ * at that policy's copies. Each policy's copies then evolve on their own.
+ * On a single node only first_touch is offered and nothing is copied;
+ * where the pages can't be placed a warning is printed once. The policy
+ * is filed with the benchmark's configuration, so its statistics show
+ * the effect of placement:
+ *
+ *   numa_placement_tuner placement("1d_stencil");
+ *   placement.track(left);
+ *   placement.track(right);
+ *   bench.run(iterations, [&](const int) { placement([&]() { ...kernel... }); });
+ */
+class numa_placement_tuner {
+public:
+    enum policy { first_touch, interleaved, socket_local };
+
+    numa_placement_tuner(const std::string& name) : name_(name + "_numa_placement") {
+        policies_.push_back(first_touch);
+        if (Impl::numa_nodes().size() > 1) {
+            policies_.push_back(interleaved);
+            policies_.push_back(socket_local);
+        }
+        std::cout << "NUMA nodes: " << Impl::numa_nodes().size() << ", candidates for " << name_ << ": ";
+        for (const int64_t p : policies_) { std::cout << policy_name(p) << ", "; }
+        std::cout << std::endl;
+        Kokkos::Tools::Experimental::VariableInfo out_info;
+        out_info.type = Kokkos::Tools::Experimental::ValueType::kokkos_value_int64;
+        out_info.category = Kokkos::Tools::Experimental::StatisticalCategory::kokkos_value_categorical;
+        out_info.valueQuantity = Kokkos::Tools::Experimental::CandidateValueType::kokkos_value_set;
+        out_info.candidates = Kokkos::Tools::Experimental::make_candidate_set(
+            policies_.size(), policies_.data());
+        answer_.push_back(Kokkos::Tools::Experimental::make_variable_value(
+            Kokkos::Tools::Experimental::declare_output_type(name_, out_info), int64_t(first_touch)));
+    }
+
+    /* Point this View handle at the copy of the policy in use. The handle
+     * should hold a first touched View, and has to outlive the tuner. */
+    template<typename ViewType>
+    void track(ViewType& view) {
+        static_assert(Impl::host_accessible<typename ViewType::memory_space>,
+                      "numa_placement_tuner places pages for host threads");
+        std::vector<ViewType> copies{view};
+        for (size_t p = 1 ; p < policies_.size() ; p++) {
+            ViewType copy(Kokkos::view_alloc(Kokkos::WithoutInitializing,
+                view.label() + " " + policy_name(policies_[p])), view.layout());
+            char* const begin = reinterpret_cast<char*>(copy.data());
+            // the pages are new, so the copy puts them where the policy says
+            place(begin, begin + copy.span() * sizeof(typename ViewType::value_type), policies_[p]);
+            Kokkos::deep_copy(copy, view);
+            copies.push_back(copy);
+        }
+        switches_.push_back([&view, copies](const int64_t from, const int64_t to) mutable {
+            copies[from] = view;
+            view = copies[to];
+        });
+    }
+
+    template<typename Body>
+    void operator()(Body body) {
+        Impl::tuning_scope scope(latch_, answer_.data(), answer_.size());
+        const int64_t wanted = answer_[0].value.int_value;
+        if (wanted != current_) {
+            for (auto& follow : switches_) {
+                follow(current_, wanted);
+            }
+            current_ = wanted;
+        }
+        Impl::log_dispatch(name_, current_);
+        body();
+    }
+
+    static const char* policy_name(const int64_t p) {
+        static const char* names[] = {"first_touch", "interleaved", "socket_local"};
+        return names[p];
+    }
+
+private:
+    void place(char* begin, char* end, const int64_t policy) {
+        const std::vector<int>& nodes = Impl::numa_nodes();
+        bool placed{true};
+        if (policy == interleaved) {
+            placed = Impl::move_pages_to(begin, end, Impl::mpol_interleave, nodes);
+        } else if (policy == socket_local) {
+            const size_t bytes = end - begin;
+            for (size_t n = 0 ; n < nodes.size() ; n++) {
+                placed &= Impl::move_pages_to(begin + bytes * n / nodes.size(),
+                    begin + bytes * (n + 1) / nodes.size(), Impl::mpol_bind, {nodes[n]});
+            }
+        }
+        if (!placed && !warned_) {
+            warned_ = true;
+            std::cout << name_ << ": could not place pages for "
+                      << policy_name(policy) << ", they follow first touch" << std::endl;
+        }
+    }
+
+    std::string name_;
+    std::vector<int64_t> policies_;
+    // per tracked View: (from, to) points its handle at the copy for to
+    std::vector<std::function<void(int64_t, int64_t)>> switches_;
+    int64_t current_{first_touch};
+    bool warned_{false};
+    std::vector<Kokkos::Tools::Experimental::VariableValue> answer_;
+    Impl::tuning_latch latch_;
+};
+
+#endif // NUMAPLACEMENT_HPP
@@ -57,7 +57,8 @@ int main(int argc, char *argv[]) {
     bool tuning = check_tuning();
     view_type left("process_this", 1000000, 25);
     Kokkos::Profiling::ScopedRegion region("occupancy search loop");
-    for (int i = 0 ; i < Impl::max_iterations ; i++) {
+    Impl::benchmark bench("occupancy");
+    bench.run(Impl::max_iterations, [&](const int) {
         Kokkos::RangePolicy<> p(0, left.extent(0));
         auto const p_occ = Kokkos::Experimental::prefer(
             p, Kokkos::Experimental::DesiredOccupancy{Kokkos::AUTO});
@@ -76,7 +77,7 @@ int main(int argc, char *argv[]) {
         } else {
             Kokkos::parallel_for("Bench", p, kernel);
         }
-    }
+    });
   }
   Kokkos::finalize();
 }
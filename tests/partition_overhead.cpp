@@ -0,0 +1,72 @@
+/**
+ * partition_overhead
+ *
+ * Complexity: low
+ * Microbenchmark, not a tuning problem:
+ *
+ * Measures what it costs per iteration to run a small kernel on a subset
+ * of the OpenMP threads, the way the tuning tests do when the tuner picks
+ * fewer than the maximum thread count. "fresh" partitions the OpenMP pool
+ * on every iteration, as the tests used to. "pooled" takes the instance
+ * from the playground's instance pool, which partitions once per thread
+ * count. The difference is the overhead the tuner used to measure along
+ * with the kernel.
+ *
+ */
+#include <tuning_playground.hpp>
+#include <search_space.hpp>
+
+#include <cstdlib>
+#include <iostream>
+
+constexpr int length{32768}; // array length
+constexpr int num_iterations{200};
+namespace KE = Kokkos::Experimental;
+using view_type = Kokkos::View<double *, Kokkos::HostSpace>;
+
+template<typename Iteration>
+double microseconds_per_iteration(Iteration iteration) {
+    Kokkos::Timer timer;
+    for (int i = 0 ; i < num_iterations ; i++) {
+        iteration();
+    }
+    Kokkos::fence();
+    return timer.seconds() * 1.0e6 / num_iterations;
+}
+
+int main(int argc, char *argv[]) {
+    Kokkos::initialize(argc, argv);
+    {
+        Kokkos::print_configuration(std::cout, false);
+        view_type source("source", length);
+        view_type dest("dest", length);
+        Kokkos::deep_copy(source, 1.0);
+        const auto kernel = KOKKOS_LAMBDA(const int x) {
+            dest(x) = (source(x-1) + source(x) + source(x+1)) / 3.0;
+        };
+        const auto stencil = [&](const Kokkos::OpenMP& instance) {
+            Kokkos::parallel_for("partition overhead stencil",
+                Kokkos::RangePolicy<Kokkos::OpenMP>(instance, 1, length - 1), kernel);
+        };
+        const int max_threads = Kokkos::OpenMP::concurrency();
+        Kokkos::Profiling::ScopedRegion region("partition_overhead loop");
+        for (const int64_t num_threads : threadCountsUpTo(max_threads - 1)) {
+            const double fresh = microseconds_per_iteration([&]() {
+                auto instances = KE::partition_space(Kokkos::OpenMP(),
+                    int(num_threads), int(max_threads - num_threads));
+                stencil(instances[0]);
+                instances[0].fence();
+            });
+            const double pooled = microseconds_per_iteration([&]() {
+                const auto& instance = Impl::openmp_instances().with_threads(num_threads);
+                stencil(instance);
+                instance.fence();
+            });
+            std::cout << "Threads: " << num_threads << ", per iteration, fresh: "
+                      << fresh << " us, pooled: " << pooled << " us, overhead: "
+                      << fresh - pooled << " us" << std::endl;
+        }
+        std::cout << "Pooled partitions: " << Impl::openmp_instances().size() << std::endl;
+    }
+    Kokkos::finalize();
+}
@@ -0,0 +1,107 @@
+/**
+ * pipelined_copy
+ *
+ * Complexity: low
+ * Microbenchmark, not a tuning problem:
+ *
+ * Every iteration stages a large input array into a working array with
+ * deep_copy, then runs a 1d, 3-point stencil on the working array. Done
+ * one after the other, the stencil waits for the whole copy. The
+ * pipelined version splits the arrays into chunks, and copies chunk i + 1
+ * on one partitioned OpenMP instance while the stencil runs on chunk i on
+ * another, with instance fences only.
+ *
+ * The copy-then-compute time is compared with the pipeline's at every
+ * chunk count and copy thread count in its search space, and every
+ * pipelined result is checked against the sequential one. Then the two
+ * are raced with fastest_of, the pipeline with its tuned shape.
+ *
+ */
+#include <tuning_playground.hpp>
+#include <pipelined_copy.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+constexpr int length{1 << 23}; // array length
+constexpr int num_repeats{10};
+constexpr int num_iterations{200};
+using view_type = Kokkos::View<double *, Kokkos::HostSpace>;
+
+// the best time of num_repeats calls, after a warm up call, in milliseconds
+template<typename Iteration>
+double best_milliseconds(Iteration iteration) {
+    iteration();
+    double best{0.0};
+    for (int i = 0 ; i < num_repeats ; i++) {
+        Kokkos::Timer timer;
+        iteration();
+        const double seconds = timer.seconds();
+        best = i == 0 ? seconds : std::min(best, seconds);
+    }
+    return best * 1.0e3;
+}
+
+int main(int argc, char *argv[]) {
+    bool passed = true;
+    Kokkos::initialize(argc, argv);
+    {
+        Kokkos::print_configuration(std::cout, false);
+        view_type input("input", length);
+        view_type work("work", length);
+        view_type output("output", length);
+        view_type expected("expected", length);
+        Kokkos::parallel_for("initialize", Kokkos::RangePolicy<Kokkos::OpenMP>(0, length),
+            KOKKOS_LAMBDA(const int x) { input(x) = x % 1000; });
+        /* The stencil on rows [begin, end), without the first and last cells */
+        const auto compute = [=](const Kokkos::OpenMP& instance, const int64_t begin, const int64_t end) {
+            Kokkos::parallel_for("pipelined stencil", Kokkos::RangePolicy<Kokkos::OpenMP>(instance,
+                std::max<int64_t>(begin, 1), std::min<int64_t>(end, length - 1)),
+                KOKKOS_LAMBDA(const int64_t x) {
+                    output(x) = (work(x - 1) + work(x) + work(x + 1)) / 3.0;
+                });
+        };
+        const auto sequential = [&]() { pipelined_copy::sequential(work, input, compute); };
+        pipelined_copy pipeline("pipelined_copy");
+        Kokkos::Profiling::ScopedRegion region("pipelined_copy loop");
+
+        sequential();
+        Kokkos::deep_copy(expected, output);
+        const double baseline = best_milliseconds(sequential);
+        const auto flags = std::cout.flags();
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "Copy then compute: " << baseline << " ms" << std::endl;
+        const search_space& space = pipeline.space();
+        for (size_t i = 0 ; i < space.size() ; i++) {
+            const int chunks = space.at(i)[pipeline.chunks_dimension()];
+            const int copy_threads = space.at(i)[pipeline.copy_threads_dimension()];
+            const auto pipelined = [&]() {
+                pipelined_copy::run(work, input, 1, chunks, copy_threads, compute);
+            };
+            Kokkos::deep_copy(output, 0.0);
+            pipelined();
+            int mismatches{0};
+            Kokkos::parallel_reduce("check", Kokkos::RangePolicy<Kokkos::OpenMP>(0, length),
+                KOKKOS_LAMBDA(const int x, int& count) { count += output(x) != expected(x); }, mismatches);
+            if (mismatches != 0) {
+                std::cout << "FAILED: " << space.describe(i) << " has " << mismatches
+                          << " wrong cells" << std::endl;
+                passed = false;
+            }
+            const double time = best_milliseconds(pipelined);
+            std::cout << "Pipelined, " << space.describe(i) << ": " << time << " ms, speedup "
+                      << baseline / time << std::endl;
+        }
+        std::cout.flags(flags);
+
+        fastest_of_tuner choose_one("choose_one", 2);
+        Impl::benchmark bench("pipelined_copy");
+        bench.run(num_iterations, [&](const int) {
+            fastest_of(choose_one, sequential, [&]() { pipeline(work, input, 1, compute); });
+        });
+    }
+    Kokkos::finalize();
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,137 @@
+#ifndef PIPELINEDCOPY_HPP
+#define PIPELINEDCOPY_HPP
+
+#include<tuning_playground.hpp>
+#include<search_space.hpp>
+#include<algorithm>
+#include<atomic>
+#include<string>
+#include<thread>
+#include<vector>
+
+#if defined(KOKKOS_ENABLE_OPENMP)
+namespace Impl {
+
+// rows [begin, end) of a rank 1, 2 or 3 View
+template<typename ViewType>
+auto rows_of(const ViewType& view, const int64_t begin, const int64_t end) {
+    const auto rows = Kokkos::make_pair(begin, end);
+    if constexpr (ViewType::rank == 1) {
+        return Kokkos::subview(view, rows);
+    } else if constexpr (ViewType::rank == 2) {
+        return Kokkos::subview(view, rows, Kokkos::ALL);
+    } else {
+        return Kokkos::subview(view, rows, Kokkos::ALL, Kokkos::ALL);
+    }
+}
+
+/* Copies src into dst and runs compute on dst, in chunks of rows, so that
+ * the copy of chunk i + 1 overlaps the compute of chunk i. A host thread
+ * drives the copies on copy_instance, fencing that instance after each
+ * chunk and then publishing how many rows are in place. The calling
+ * thread drives compute(compute_instance, begin, end) on compute_instance,
+ * starting each chunk once it and halo rows past it have been copied.
+ * Only the two instances are fenced, never the whole pool. */
+template<typename DstType, typename SrcType, typename Compute>
+void pipelined_copy_compute(const Kokkos::OpenMP& copy_instance, const Kokkos::OpenMP& compute_instance,
+                            const DstType& dst, const SrcType& src, const int chunks,
+                            const int64_t halo, const Compute& compute) {
+    const int64_t rows = dst.extent(0);
+    const auto chunk_begin = [=](const int i) { return rows * i / chunks; };
+    std::atomic<int64_t> copied{0};
+    std::thread copier([&]() {
+        for (int i = 0 ; i < chunks ; i++) {
+            const int64_t begin = chunk_begin(i);
+            const int64_t end = chunk_begin(i + 1);
+            Kokkos::deep_copy(copy_instance, rows_of(dst, begin, end), rows_of(src, begin, end));
+            copy_instance.fence("pipelined copy: chunk copied");
+            copied.store(end, std::memory_order_release);
+        }
+    });
+    for (int i = 0 ; i < chunks ; i++) {
+        const int64_t begin = chunk_begin(i);
+        const int64_t end = chunk_begin(i + 1);
+        const int64_t needed = std::min(rows, end + halo);
+        while (copied.load(std::memory_order_acquire) < needed) {
+            std::this_thread::yield();
+        }
+        compute(compute_instance, begin, end);
+    }
+    compute_instance.fence("pipelined copy: chunks computed");
+    copier.join();
+}
+
+} // namespace Impl
+
+/* A copy that stages data for a kernel, followed by the kernel, as one
+ * tuned pipeline: the rows of dst are split into chunks, and the copy of
+ * each chunk overlaps the compute of the one before, on two instances
+ * from partitioning the OpenMP pool. The number of chunks and the number
+ * of threads given to the copy are one search space, requested in a
+ * context of its own, so the pipeline can be offered beside the plain
+ * copy-then-compute with fastest_of:
+ *
+ *   pipelined_copy pipeline("stage_and_smooth");
+ *   fastest_of(tuner, [&]() { pipelined_copy::sequential(work, input, compute); },
+ *       [&]() { pipeline(work, input, 1, compute); });
+ *
+ * compute(instance, begin, end) has to run rows [begin, end) of its
+ * kernel on the given instance, and may read up to halo rows of dst past
+ * them. */
+class pipelined_copy {
+public:
+    pipelined_copy(const std::string& name) : total_threads_(Kokkos::OpenMP().concurrency()) {
+        d_chunks_ = space_.add_dimension("chunks", {2, 4, 8, 16, 32, 64});
+        // the copy is bandwidth bound, so it is given at most half the threads
+        d_copy_threads_ = space_.add_dimension("copy_threads",
+            powersOfTwoUpTo(std::max<int64_t>(1, total_threads_ / 2)));
+        const int64_t defaults = std::max<int64_t>(0,
+            space_.index_of({8, std::max<int64_t>(1, total_threads_ / 8)}));
+        answer_vector_.push_back(Kokkos::Tools::Experimental::make_variable_value(
+            space_.declare_output(name + "_pipeline"), defaults));
+    }
+
+    template<typename DstType, typename SrcType, typename Compute>
+    void operator()(const DstType& dst, const SrcType& src, const int64_t halo, const Compute& compute) {
+        Impl::tuning_scope scope(latch_, answer_vector_.data(), answer_vector_.size());
+        const search_space::point& point = space_.at(answer_vector_[0].value.int_value);
+        run(dst, src, halo, point[d_chunks_], point[d_copy_threads_], compute);
+    }
+
+    // the untuned form, for reporting every point of the space
+    template<typename DstType, typename SrcType, typename Compute>
+    static void run(const DstType& dst, const SrcType& src, const int64_t halo,
+                    const int chunks, const int copy_threads, const Compute& compute) {
+        const int total_threads = Kokkos::OpenMP().concurrency();
+        if (copy_threads >= total_threads) {
+            sequential(dst, src, compute);
+            return;
+        }
+        const auto& instances = Impl::openmp_instances().partition({copy_threads, total_threads - copy_threads});
+        Impl::pipelined_copy_compute(instances[0], instances[1], dst, src, chunks, halo, compute);
+    }
+
+    // the copy, then the compute, each on the whole pool
+    template<typename DstType, typename SrcType, typename Compute>
+    static void sequential(const DstType& dst, const SrcType& src, const Compute& compute) {
+        const Kokkos::OpenMP pool;
+        Kokkos::deep_copy(pool, dst, src);
+        compute(pool, 0, int64_t(dst.extent(0)));
+        pool.fence("pipelined copy: sequential");
+    }
+
+    const search_space& space() const { return space_; }
+    size_t chunks_dimension() const { return d_chunks_; }
+    size_t copy_threads_dimension() const { return d_copy_threads_; }
+
+private:
+    int64_t total_threads_;
+    search_space space_;
+    size_t d_chunks_;
+    size_t d_copy_threads_;
+    std::vector<Kokkos::Tools::Experimental::VariableValue> answer_vector_;
+    Impl::tuning_latch latch_;
+};
+#endif
+
+#endif // PIPELINEDCOPY_HPP
@@ -0,0 +1,65 @@
+#ifndef RANDOMDATA_HPP
+#define RANDOMDATA_HPP
+
+#include<tuning_playground.hpp>
+#include<Kokkos_Random.hpp>
+#include<cstdint>
+
+namespace Impl {
+
+// cells drawn from one generator, the unit of work of fill_uniform
+constexpr const int64_t random_block{4096};
+
+// the seed of the benchmark data, PLAYGROUND_SEED if it is set
+inline uint64_t data_seed() {
+    static const uint64_t seed = env_setting("PLAYGROUND_SEED", 20240125);
+    return seed;
+}
+
+/* splitmix64, to turn (seed, block) into well mixed generator states:
+ * neighbouring blocks must not start from neighbouring states. */
+KOKKOS_INLINE_FUNCTION uint64_t mix_seed(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ull;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+} // namespace Impl
+
+/* Fills a contiguous View of any rank with whole numbers drawn uniformly
+ * from [lower, upper], in parallel, the way the benchmarks used to fill
+ * them serially with rand().
+ *
+ * A Random_XorShift64_Pool hands its states to whichever thread asks, so
+ * the numbers would depend on the thread count and on the schedule.
+ * Instead, every block of random_block cells in memory order gets its own
+ * XorShift64 generator, seeded from the seed and the block index alone:
+ * the data are bit-identical for any number of threads, and from run to
+ * run, which keeps the tuning runs comparable. */
+template<typename ViewType>
+void fill_uniform(const ViewType& view, const int64_t lower, const int64_t upper,
+                  const uint64_t seed = Impl::data_seed()) {
+    using value_type = typename ViewType::non_const_value_type;
+    using execution_space = typename ViewType::execution_space;
+    using generator_type = Kokkos::Random_XorShift64<execution_space>;
+    if (!view.span_is_contiguous()) {
+        Kokkos::abort("fill_uniform needs a contiguous View");
+    }
+    value_type* const data = view.data();
+    const int64_t cells = view.span();
+    const int64_t blocks = (cells + Impl::random_block - 1) / Impl::random_block;
+    Kokkos::parallel_for("fill uniform", Kokkos::RangePolicy<execution_space,
+        Kokkos::Schedule<Kokkos::Static>, Kokkos::IndexType<int64_t>>(0, blocks),
+        KOKKOS_LAMBDA(const int64_t block) {
+            generator_type generator(Impl::mix_seed(seed ^ Impl::mix_seed(block)));
+            const int64_t first = block * Impl::random_block;
+            const int64_t last = Kokkos::min(first + Impl::random_block, cells);
+            for (int64_t i = first ; i < last ; i++) {
+                data[i] = value_type(generator.rand64(lower, upper + 1));
+            }
+        });
+    execution_space().fence();
+}
+
+#endif // RANDOMDATA_HPP
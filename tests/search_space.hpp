@@ -0,0 +1,429 @@
+#ifndef SEARCHSPACE_HPP
+#define SEARCHSPACE_HPP
+
+#include<tuning_playground.hpp>
+#include<algorithm>
+#include<cmath>
+#include<cstdlib>
+#include<fstream>
+#include<functional>
+#include<iostream>
+#include<string>
+#include<vector>
+#include<unistd.h>
+
+namespace Impl {
+
+// parse a cache size from /sys, like "1024K"
+inline size_t parse_cache_size(const std::string& text) {
+    size_t value = std::strtoull(text.c_str(), nullptr, 10);
+    if (text.find('K') != std::string::npos) {
+        value *= 1024;
+    } else if (text.find('M') != std::string::npos) {
+        value *= 1024 * 1024;
+    }
+    return value;
+}
+
+/* The size of the level 1 (data), 2 or 3 cache seen by one core, in
+ * bytes. PLAYGROUND_L<level>_BYTES overrides it, then sysconf and /sys
+ * are tried, and the fallback is the guess if neither knows. */
+inline size_t cache_bytes(const int level, const size_t fallback) {
+    const std::string name{"PLAYGROUND_L" + std::to_string(level) + "_BYTES"};
+    const char* setting{getenv(name.c_str())};
+    if (setting != nullptr) {
+        return std::strtoull(setting, nullptr, 10);
+    }
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+    const int sysconf_names[] = {_SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE};
+    if (level >= 1 && level <= 3) {
+        const long from_sysconf = sysconf(sysconf_names[level - 1]);
+        if (from_sysconf > 0) {
+            return from_sysconf;
+        }
+    }
+#endif
+    for (int index = 0 ; index < 8 ; index++) {
+        const std::string path{"/sys/devices/system/cpu/cpu0/cache/index" +
+            std::to_string(index) + "/"};
+        std::ifstream level_file(path + "level");
+        int this_level{0};
+        if (!(level_file >> this_level)) {
+            break;
+        }
+        std::ifstream type_file(path + "type");
+        std::string type;
+        type_file >> type;
+        std::ifstream size_file(path + "size");
+        std::string size;
+        if (this_level == level && type != "Instruction" && (size_file >> size)) {
+            return parse_cache_size(size);
+        }
+    }
+    return fallback;
+}
+
+// The size of the L1 data cache of one core, 32 KiB if unknown
+inline size_t l1_cache_bytes() {
+    return cache_bytes(1, 32 * 1024);
+}
+
+// The size of the L2 cache of one core, 1 MiB if unknown
+inline size_t l2_cache_bytes() {
+    return cache_bytes(2, 1024 * 1024);
+}
+
+// The size of the last level cache: L3 if there is one, else L2
+inline size_t last_level_cache_bytes() {
+    const size_t l3_bytes = cache_bytes(3, 0);
+    return l3_bytes > 0 ? l3_bytes : l2_cache_bytes();
+}
+
+} // namespace Impl
+
+// Helper function to generate tile sizes that evenly divide an extent
+inline std::vector<int64_t> divisorsOf(const int64_t size) {
+    std::vector<int64_t> divisors;
+    for (int64_t i = 1 ; i <= size ; i++) {
+        if (size % i == 0) {
+            divisors.push_back(i);
+        }
+    }
+    return divisors;
+}
+
+// Helper function to generate thread counts: the even counts up to size,
+// just 1 if size is 1, and none if size is less than 1
+inline std::vector<int64_t> threadCountsUpTo(const int64_t size) {
+    std::vector<int64_t> range;
+    for (int64_t i = size < 2 ? 1 : 2 ; i <= size ; i += 2) {
+        range.push_back(i);
+    }
+    return range;
+}
+
+// Helper function to generate power of two sizes, like team sizes
+inline std::vector<int64_t> powersOfTwoUpTo(const int64_t size) {
+    std::vector<int64_t> powers;
+    for (int64_t i = 1 ; i <= size ; i *= 2) {
+        powers.push_back(i);
+    }
+    return powers;
+}
+
+/* Pick about `points` values from sorted, positive candidates, spaced
+ * evenly on a log scale between the first and the last. */
+inline std::vector<int64_t> log_spaced(const std::vector<int64_t>& sorted, const size_t points) {
+    if (sorted.size() <= points || points < 2) {
+        return sorted;
+    }
+    const double low = std::log(double(sorted.front()));
+    const double high = std::log(double(sorted.back()));
+    std::vector<int64_t> picked;
+    for (size_t i = 0 ; i < points ; i++) {
+        const double target = low + (high - low) * i / (points - 1);
+        // the candidate nearest to the target, on the log scale
+        auto nearest = std::min_element(sorted.begin(), sorted.end(),
+            [target](const int64_t a, const int64_t b) {
+                return std::fabs(std::log(double(a)) - target) <
+                       std::fabs(std::log(double(b)) - target);
+            });
+        if (picked.empty() || picked.back() != *nearest) {
+            picked.push_back(*nearest);
+        }
+    }
+    return picked;
+}
+
+/* A coarse-to-fine ordinal tuning variable. Of all the admissible values
+ * (every chunk size that divides the array, every thread count...), the
+ * tuner first sees a coarse log-spaced grid of about `points` of them.
+ * Once its answer has been the same for PLAYGROUND_REFINE_WINDOW requests
+ * in a row (default 50), a finer ordinal variable is declared with the
+ * admissible values between the neighbours of that answer, and the tuner
+ * starts over on it, from the coarse answer. This repeats until there is
+ * nothing finer to offer.
+ *
+ * The candidate set of a declared variable can't change, which is why
+ * each level is a new variable. The level is also an input, so that each
+ * level is a tuning context of its own to the tool, rather than one
+ * context whose output changed partway through. Put level_input() in the
+ * input vector and answer() in the answer vector before each request,
+ * and pass the request's answer to observe():
+ *
+ *   multiresolution_variable chunk("chunk_out", divisorsOf(length), 8);
+ *   input_vector[3] = chunk.level_input();
+ *   answer_vector[0] = chunk.answer();
+ *   scope.request(answer_vector.data(), answer_vector.size(),
+ *       input_vector.data(), input_vector.size());
+ *   int64_t chunk_size = chunk.observe(answer_vector[0]);
+ */
+class multiresolution_variable {
+public:
+    multiresolution_variable(const std::string& name, std::vector<int64_t> admissible,
+                             const size_t points = 8) :
+        name_(name), points_(std::max<size_t>(points, 2)),
+        window_(std::max<int64_t>(1, Impl::env_setting("PLAYGROUND_REFINE_WINDOW", 50))) {
+        std::sort(admissible.begin(), admissible.end());
+        admissible.erase(std::unique(admissible.begin(), admissible.end()), admissible.end());
+        if (admissible.empty() || admissible.front() <= 0) {
+            Kokkos::abort("multiresolution_variable: needs positive admissible values");
+        }
+        admissible_ = admissible;
+        Kokkos::Tools::Experimental::VariableInfo in_info;
+        in_info.type = Kokkos::Tools::Experimental::ValueType::kokkos_value_int64;
+        in_info.category = Kokkos::Tools::Experimental::StatisticalCategory::kokkos_value_categorical;
+        in_info.valueQuantity = Kokkos::Tools::Experimental::CandidateValueType::kokkos_value_unbounded;
+        level_id_ = Kokkos::Tools::Experimental::declare_input_type(name_ + ".level", in_info);
+        declare(log_spaced(admissible_, points_));
+        incumbent_ = candidates_[candidates_.size() / 2];
+    }
+
+    // the answer to request: the current level's variable, defaulting to the incumbent
+    Kokkos::Tools::Experimental::VariableValue answer() const {
+        return Kokkos::Tools::Experimental::make_variable_value(variable_id_, incumbent_);
+    }
+
+    // the input that tells the levels apart
+    Kokkos::Tools::Experimental::VariableValue level_input() const {
+        return Kokkos::Tools::Experimental::make_variable_value(level_id_, int64_t(level_));
+    }
+
+    // start from a different default than the middle of the coarse grid
+    void set_default(const int64_t value) {
+        incumbent_ = nearest(value);
+    }
+
+    /* Record the tuner's answer, refine if it has settled, and return the
+     * value to use. */
+    int64_t observe(const Kokkos::Tools::Experimental::VariableValue& answer) {
+        const int64_t value = answer.value.int_value;
+        if (value == incumbent_) {
+            stable_++;
+        } else {
+            incumbent_ = value;
+            stable_ = 1;
+        }
+        if (stable_ >= window_ && !finest_) {
+            refine();
+        }
+        return value;
+    }
+
+    size_t level() const { return level_; }
+
+private:
+    // the current candidate closest to the given value
+    int64_t nearest(const int64_t value) const {
+        return *std::min_element(candidates_.begin(), candidates_.end(),
+            [value](const int64_t a, const int64_t b) {
+                return std::abs(a - value) < std::abs(b - value);
+            });
+    }
+
+    void declare(const std::vector<int64_t>& candidates) {
+        candidates_ = candidates;
+        std::string varname{name_};
+        if (level_ > 0) {
+            varname += ".level" + std::to_string(level_);
+        }
+        std::cout << "Candidates for " << varname << ": ";
+        for (const int64_t c : candidates_) { std::cout << c << ", "; }
+        std::cout << std::endl;
+        Kokkos::Tools::Experimental::VariableInfo out_info;
+        out_info.type = Kokkos::Tools::Experimental::ValueType::kokkos_value_int64;
+        out_info.category = Kokkos::Tools::Experimental::StatisticalCategory::kokkos_value_ordinal;
+        out_info.valueQuantity = Kokkos::Tools::Experimental::CandidateValueType::kokkos_value_set;
+        out_info.candidates = Kokkos::Tools::Experimental::make_candidate_set(
+            candidates_.size(), candidates_.data());
+        variable_id_ = Kokkos::Tools::Experimental::declare_output_type(varname, out_info);
+    }
+
+    // declare the admissible values between the incumbent's neighbours
+    void refine() {
+        const auto where = std::find(candidates_.begin(), candidates_.end(), incumbent_);
+        if (where == candidates_.end()) {
+            finest_ = true;
+            return;
+        }
+        const int64_t low = where == candidates_.begin() ? incumbent_ : *(where - 1);
+        const int64_t high = where + 1 == candidates_.end() ? incumbent_ : *(where + 1);
+        std::vector<int64_t> finer;
+        for (const int64_t value : admissible_) {
+            if (value >= low && value <= high) {
+                finer.push_back(value);
+            }
+        }
+        finer = log_spaced(finer, points_);
+        if (std::find(finer.begin(), finer.end(), incumbent_) == finer.end()) {
+            finer.insert(std::upper_bound(finer.begin(), finer.end(), incumbent_), incumbent_);
+        }
+        // nothing new between the neighbours, so this is as fine as it gets
+        if (std::all_of(finer.begin(), finer.end(), [this](const int64_t value) {
+                return std::find(candidates_.begin(), candidates_.end(), value) != candidates_.end();
+            })) {
+            finest_ = true;
+            return;
+        }
+        level_++;
+        stable_ = 0;
+        declare(finer);
+    }
+
+    const std::string name_;
+    const size_t points_;
+    const int64_t window_;
+    std::vector<int64_t> admissible_;
+    std::vector<int64_t> candidates_;
+    size_t variable_id_{0};
+    size_t level_id_{0};
+    size_t level_{0};
+    int64_t incumbent_{0};
+    int64_t stable_{0};
+    bool finest_{false};
+};
+
+/* A joint search space over several tuning parameters, with constraints
+ * between them. Instead of declaring one output variable per parameter,
+ * and letting the tuner wander through combinations that can't work,
+ * declare_output() enumerates the cartesian product of the dimensions,
+ * keeps the points that satisfy every constraint, and declares a single
+ * categorical output whose values are the indices of those points.
+ *
+ *   search_space space;
+ *   const size_t ti = space.add_dimension("ti", divisorsOf(M));
+ *   const size_t tj = space.add_dimension("tj", divisorsOf(N));
+ *   space.add_constraint("fits in L2", [=](const search_space::point& p) {
+ *       return p[ti] * p[tj] * sizeof(double) <= Impl::l2_cache_bytes();
+ *   });
+ *   size_t id = space.declare_output("tiling");
+ *   ... request the output, then space.at(answer.value.int_value)[ti]
+ */
+class search_space {
+public:
+    using point = std::vector<int64_t>;
+    using constraint = std::function<bool(const point&)>;
+
+    // add a dimension, and return its index in every point
+    size_t add_dimension(const std::string& name, const std::vector<int64_t>& values) {
+        names_.push_back(name);
+        values_.push_back(values);
+        return names_.size() - 1;
+    }
+
+    // add a constraint that every feasible point has to satisfy
+    void add_constraint(const std::string& description, constraint predicate) {
+        constraints_.push_back({description, predicate, 0});
+    }
+
+    /* Enumerate the feasible points and declare them as a categorical
+     * output variable. Reports how much each constraint pruned. */
+    size_t declare_output(const std::string& varname) {
+        enumerate();
+        std::cout << "Search space " << varname << ": " << feasible_.size()
+                  << " of " << product_size() << " points are feasible" << std::endl;
+        for (const auto& c : constraints_) {
+            std::cout << "  '" << c.description << "' rejected " << c.rejected
+                      << " points" << std::endl;
+        }
+        if (feasible_.empty()) {
+            Kokkos::abort("search_space: no point satisfies every constraint");
+        }
+        std::vector<int64_t> candidates(feasible_.size());
+        for (size_t i = 0 ; i < candidates.size() ; i++) {
+            candidates[i] = i;
+        }
+        Kokkos::Tools::Experimental::VariableInfo out_info;
+        out_info.type = Kokkos::Tools::Experimental::ValueType::kokkos_value_int64;
+        out_info.category = Kokkos::Tools::Experimental::StatisticalCategory::kokkos_value_categorical;
+        out_info.valueQuantity = Kokkos::Tools::Experimental::CandidateValueType::kokkos_value_set;
+        out_info.candidates = Kokkos::Tools::Experimental::make_candidate_set(
+            candidates.size(), candidates.data());
+        return Kokkos::Tools::Experimental::declare_output_type(varname, out_info);
+    }
+
+    // the feasible point with the given index (the value of the output)
+    const point& at(const int64_t index) const {
+        if (index < 0 || size_t(index) >= feasible_.size()) {
+            Kokkos::abort("search_space: index out of range");
+        }
+        return feasible_[index];
+    }
+
+    // the index of a feasible point, or -1 if it isn't one
+    int64_t index_of(const point& p) const {
+        for (size_t i = 0 ; i < feasible_.size() ; i++) {
+            if (feasible_[i] == p) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // human readable form of a point, like "ti=4,tj=8"
+    std::string describe(const int64_t index) const {
+        const point& p = at(index);
+        std::string text;
+        for (size_t d = 0 ; d < names_.size() ; d++) {
+            text += (d == 0 ? "" : ",") + names_[d] + "=" + std::to_string(p[d]);
+        }
+        return text;
+    }
+
+    size_t size() const { return feasible_.size(); }
+
+    size_t product_size() const {
+        size_t product{1};
+        for (const auto& values : values_) {
+            product *= values.size();
+        }
+        return product;
+    }
+
+private:
+    struct named_constraint {
+        std::string description;
+        constraint predicate;
+        size_t rejected;
+    };
+
+    // walk the cartesian product like an odometer, keeping feasible points
+    void enumerate() {
+        feasible_.clear();
+        if (values_.empty() || product_size() == 0) {
+            return;
+        }
+        std::vector<size_t> digits(values_.size(), 0);
+        point p(values_.size());
+        while (true) {
+            for (size_t d = 0 ; d < values_.size() ; d++) {
+                p[d] = values_[d][digits[d]];
+            }
+            bool feasible{true};
+            for (auto& c : constraints_) {
+                if (!c.predicate(p)) {
+                    c.rejected++;
+                    feasible = false;
+                    break;
+                }
+            }
+            if (feasible) {
+                feasible_.push_back(p);
+            }
+            size_t d = 0;
+            while (d < digits.size() && ++digits[d] == values_[d].size()) {
+                digits[d++] = 0;
+            }
+            if (d == digits.size()) {
+                break;
+            }
+        }
+    }
+
+    std::vector<std::string> names_;
+    std::vector<std::vector<int64_t>> values_;
+    std::vector<named_constraint> constraints_;
+    std::vector<point> feasible_;
+};
+
+#endif // SEARCHSPACE_HPP
@@ -0,0 +1,170 @@
+#ifndef SIMDSTENCIL_HPP
+#define SIMDSTENCIL_HPP
+
+#include<tuning_playground.hpp>
+#include<Kokkos_SIMD.hpp>
+#include<string>
+#include<type_traits>
+#include<vector>
+
+namespace Impl {
+
+// the widest ABI the host supports for doubles
+using native_simd_abi = Kokkos::Experimental::native_simd<double>::abi_type;
+
+/* Reads the neighbours of a vector of cells: at(dx, dy, dz) loads the
+ * cells at that offset from each of them. Like Impl::tile_accessor, but
+ * with a simd value per offset, so the same generic stencil lambda works
+ * with both. The ABIs are the host's, so this only runs on the host. */
+template<typename Abi>
+struct simd_accessor {
+    using simd_type = Kokkos::Experimental::simd<double, Abi>;
+    const double* center;
+    int64_t stride[3];
+    inline simd_type operator()(const int dx, const int dy = 0, const int dz = 0) const {
+        simd_type value;
+        value.copy_from(center + dx * stride[0] + dy * stride[1] + dz * stride[2],
+                        Kokkos::Experimental::element_aligned_tag());
+        return value;
+    }
+};
+
+/* Updates the vector of cells that starts at (i, j, k). Leading indices
+ * past the view's rank are 0. */
+template<typename Abi, typename ViewType, typename Stencil>
+struct simd_update {
+    ViewType from;
+    ViewType to;
+    Stencil stencil;
+    int64_t stride[3];
+
+    inline void operator()(const int i, const int j, const int k) const {
+        const int64_t offset = i * stride[0] + j * stride[1] + k * stride[2];
+        const auto result = stencil(simd_accessor<Abi>{from.data() + offset,
+                                                       {stride[0], stride[1], stride[2]}});
+        result.copy_to(to.data() + offset, Kokkos::Experimental::element_aligned_tag());
+    }
+};
+
+template<typename Abi, typename ViewType, typename Stencil>
+simd_update<Abi, ViewType, Stencil> make_simd_update(const ViewType& from, const ViewType& to,
+                                                     const Stencil& stencil) {
+    simd_update<Abi, ViewType, Stencil> update{from, to, stencil, {0, 0, 0}};
+    for (unsigned d = 0 ; d < ViewType::rank ; d++) {
+        update.stride[d] = from.stride(d);
+    }
+    return update;
+}
+
+} // namespace Impl
+
+/* One Jacobi sweep of the cells in [lo, hi) along every dimension, from
+ * source into dest, vectorized along the unit-stride (last) dimension with
+ * the given ABI. The cells left over after the last full vector are peeled
+ * off and updated with the scalar ABI, so there is no masking and no
+ * branch in the vector loop. The SIMD ABIs are the host's, so the sweep
+ * runs on the default host execution space, and the views have to be
+ * host accessible; offer it through Impl::on_host where they may not be.
+ * The stencil is a generic lambda, like
+ * [](const auto& at) { return (at(-1) + at(0) + at(1)) / 3.0; } */
+template<typename Abi, typename ViewType, typename Stencil>
+void simd_sweep(const std::string& name, const ViewType& from, const ViewType& to,
+                const int lo, const int hi, const Stencil& stencil) {
+    constexpr int rank = ViewType::rank;
+    static_assert(rank == 1 || std::is_same<typename ViewType::array_layout, Kokkos::LayoutRight>::value,
+                  "simd_sweep vectorizes along the last dimension, which has to be unit-stride");
+    static_assert(Impl::host_accessible<typename ViewType::memory_space>,
+                  "simd_sweep runs on the host, so its views have to be host accessible");
+    using execution_space = Kokkos::DefaultHostExecutionSpace;
+    constexpr int width = Kokkos::Experimental::simd<double, Abi>::size();
+    const int vectors = (hi - lo) / width;
+    const int peeled = lo + vectors * width;
+    const auto vector_update = Impl::make_simd_update<Abi>(from, to, stencil);
+    const auto scalar_update = Impl::make_simd_update<Kokkos::Experimental::simd_abi::scalar>(from, to, stencil);
+    if constexpr (rank == 1) {
+        Kokkos::parallel_for(name, Kokkos::RangePolicy<execution_space>(0, vectors),
+            [=](const int v) { vector_update(lo + v * width, 0, 0); });
+        Kokkos::parallel_for(name + " remainder", Kokkos::RangePolicy<execution_space>(peeled, hi),
+            [=](const int x) { scalar_update(x, 0, 0); });
+    } else if constexpr (rank == 2) {
+        Kokkos::parallel_for(name, Kokkos::MDRangePolicy<execution_space, Kokkos::Rank<2>>(
+            {lo, 0}, {hi, vectors}),
+            [=](const int x, const int v) { vector_update(x, lo + v * width, 0); });
+        Kokkos::parallel_for(name + " remainder", Kokkos::MDRangePolicy<execution_space, Kokkos::Rank<2>>(
+            {lo, peeled}, {hi, hi}),
+            [=](const int x, const int y) { scalar_update(x, y, 0); });
+    } else {
+        Kokkos::parallel_for(name, Kokkos::MDRangePolicy<execution_space, Kokkos::Rank<3>>(
+            {lo, lo, 0}, {hi, hi, vectors}),
+            [=](const int x, const int y, const int v) { vector_update(x, y, lo + v * width); });
+        Kokkos::parallel_for(name + " remainder", Kokkos::MDRangePolicy<execution_space, Kokkos::Rank<3>>(
+            {lo, lo, peeled}, {hi, hi, hi}),
+            [=](const int x, const int y, const int z) { scalar_update(x, y, z); });
+    }
+}
+
+/* The SIMD width to use, as a tuning output. The candidates are the
+ * widths of the ABIs this build supports for doubles: scalar, the native
+ * one, and AVX2 on AVX-512 hosts, where the narrower vectors sometimes
+ * win on bandwidth-bound kernels. The width is requested in a context of
+ * its own, nested in the fastest_of context of the SIMD variant, and the
+ * body is called with a value of the chosen ABI type:
+ *
+ *   simd_width_tuner simd("2d_stencil");
+ *   fastest_of(tuner, ..., [&]() {
+ *       simd([&](auto abi) {
+ *           simd_sweep<decltype(abi)>("2d simd", source, dest, lo, hi, stencil);
+ *       });
+ *   });
+ */
+class simd_width_tuner {
+public:
+    simd_width_tuner(const std::string& name) {
+        widths_.push_back(1);
+#if defined(KOKKOS_ARCH_AVX512XEON)
+        widths_.push_back(Kokkos::Experimental::simd<double,
+            Kokkos::Experimental::simd_abi::avx2_fixed_size<4>>::size());
+#endif
+        if (native_width() > 1) {
+            widths_.push_back(native_width());
+        }
+        std::cout << "Candidates for " << name << "_simd_width: ";
+        for (const int64_t w : widths_) { std::cout << w << ", "; }
+        std::cout << std::endl;
+        Kokkos::Tools::Experimental::VariableInfo out_info;
+        out_info.type = Kokkos::Tools::Experimental::ValueType::kokkos_value_int64;
+        out_info.category = Kokkos::Tools::Experimental::StatisticalCategory::kokkos_value_categorical;
+        out_info.valueQuantity = Kokkos::Tools::Experimental::CandidateValueType::kokkos_value_set;
+        out_info.candidates = Kokkos::Tools::Experimental::make_candidate_set(
+            widths_.size(), widths_.data());
+        answer_.push_back(Kokkos::Tools::Experimental::make_variable_value(
+            Kokkos::Tools::Experimental::declare_output_type(name + "_simd_width", out_info),
+            native_width()));
+    }
+
+    template<typename Body>
+    void operator()(Body body) {
+        Impl::tuning_scope scope(latch_, answer_.data(), answer_.size());
+        const int64_t width = answer_[0].value.int_value;
+        if (width == native_width()) {
+            body(Impl::native_simd_abi{});
+#if defined(KOKKOS_ARCH_AVX512XEON)
+        } else if (width == 4) {
+            body(Kokkos::Experimental::simd_abi::avx2_fixed_size<4>{});
+#endif
+        } else {
+            body(Kokkos::Experimental::simd_abi::scalar{});
+        }
+    }
+
+private:
+    static int64_t native_width() {
+        return Kokkos::Experimental::simd<double, Impl::native_simd_abi>::size();
+    }
+
+    std::vector<int64_t> widths_;
+    std::vector<Kokkos::Tools::Experimental::VariableValue> answer_;
+    Impl::tuning_latch latch_;
+};
+
+#endif // SIMDSTENCIL_HPP
@@ -0,0 +1,193 @@
+#ifndef STREAMINGSTORE_HPP
+#define STREAMINGSTORE_HPP
+
+#include<tuning_playground.hpp>
+#include<search_space.hpp>
+#include<temporal_blocking.hpp>
+#include<cstring>
+#include<string>
+#include<type_traits>
+#include<vector>
+#if defined(__SSE2__) && defined(__x86_64__)
+#include<emmintrin.h>
+#endif
+
+namespace Impl {
+
+/* Non-temporal stores of 4 and 8 byte values: movnti on x86-64, and plain
+ * stores everywhere else. */
+#if defined(__SSE2__) && defined(__x86_64__)
+constexpr bool streaming_stores_supported{true};
+#else
+constexpr bool streaming_stores_supported{false};
+#endif
+
+#if defined(__SSE2__) && defined(__x86_64__)
+// movnti, which only exists on the host
+template<typename Scalar>
+inline void stream_store(Scalar* address, const Scalar value) {
+    if constexpr (sizeof(Scalar) == 8) {
+        long long bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        _mm_stream_si64(reinterpret_cast<long long*>(address), bits);
+    } else {
+        int bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        _mm_stream_si32(reinterpret_cast<int*>(address), bits);
+    }
+}
+#endif
+
+/* Stores value at address, bypassing the cache if Streaming. A streaming
+ * store writes the line without reading it first, so an output that
+ * doesn't fit in cache costs one transfer per line instead of two, but
+ * the line is not in cache afterwards. On a device this is a plain
+ * store: the intrinsics are only compiled for the host. */
+template<bool Streaming, typename Scalar>
+KOKKOS_INLINE_FUNCTION void store(Scalar* address, const Scalar value) {
+#if defined(__SSE2__) && defined(__x86_64__)
+    if constexpr (Streaming && std::is_trivially_copyable<Scalar>::value &&
+                  (sizeof(Scalar) == 8 || sizeof(Scalar) == 4)) {
+        KOKKOS_IF_ON_HOST((stream_store(address, value); return;))
+    }
+#endif
+    *address = value;
+}
+
+/* Streaming stores are weakly ordered, so every thread that made some
+ * has to fence before the kernel ends and another thread reads them.
+ * Call this at the end of each work item. */
+template<bool Streaming>
+KOKKOS_INLINE_FUNCTION void store_fence() {
+#if defined(__SSE2__) && defined(__x86_64__)
+    if constexpr (Streaming) {
+        KOKKOS_IF_ON_HOST((_mm_sfence();))
+    }
+#endif
+}
+
+// the input variable for the output size relative to the last level cache
+inline size_t llc_ratio_variable_id() {
+    using namespace Kokkos::Tools::Experimental;
+    static const size_t id = [](){
+        VariableInfo info;
+        info.category = StatisticalCategory::kokkos_value_categorical;
+        info.type = ValueType::kokkos_value_int64;
+        info.valueQuantity = CandidateValueType::kokkos_value_unbounded;
+        std::lock_guard<std::mutex> lock(tuning_api_mutex());
+        return declare_input_type("playground.llc_ratio_class", info);
+    }();
+    return id;
+}
+
+} // namespace Impl
+
+/* One Jacobi sweep of the cells in [lo, hi) along every dimension, from
+ * source into dest, with a row of the unit-stride (last) dimension per
+ * work item, so that its stores are contiguous and it can end with a
+ * store fence. The stores are streaming if Streaming. Streaming stores
+ * are a host feature, so the sweep runs on the default host execution
+ * space, and the views have to be host accessible; offer it through
+ * Impl::on_host where they may not be. The stencil is a generic lambda,
+ * called with an Impl::tile_accessor, like
+ * [](const auto& at) { return (at(-1) + at(0) + at(1)) / 3.0; } */
+template<bool Streaming, typename ViewType, typename Stencil>
+void row_sweep(const std::string& name, const ViewType& from, const ViewType& to,
+               const int lo, const int hi, const Stencil& stencil) {
+    constexpr int rank = ViewType::rank;
+    static_assert(rank == 1 || std::is_same<typename ViewType::array_layout, Kokkos::LayoutRight>::value,
+                  "row_sweep stores along the last dimension, which has to be unit-stride");
+    static_assert(Impl::host_accessible<typename ViewType::memory_space>,
+                  "row_sweep runs on the host, so its views have to be host accessible");
+    using execution_space = Kokkos::DefaultHostExecutionSpace;
+    int64_t stride[3] = {0, 0, 0};
+    for (int d = 0 ; d < rank ; d++) {
+        stride[d] = from.stride(d);
+    }
+    const double* source = from.data();
+    double* dest = to.data();
+    // the cells [begin, end) of the row that starts at offset
+    const auto row = [=](const int64_t offset, const int begin, const int end) {
+        for (int i = begin ; i < end ; i++) {
+            const int64_t o = offset + i * stride[rank - 1];
+            Impl::store<Streaming>(dest + o,
+                stencil(Impl::tile_accessor{source + o, {stride[0], stride[1], stride[2]}}));
+        }
+        Impl::store_fence<Streaming>();
+    };
+    if constexpr (rank == 1) {
+        // a 1D grid is one row, so it is split into rows of this many cells
+        constexpr int cells{4096};
+        Kokkos::parallel_for(name, Kokkos::RangePolicy<execution_space>(0, (hi - lo + cells - 1) / cells),
+            [=](const int r) { row(0, lo + r * cells, Kokkos::min(lo + (r + 1) * cells, hi)); });
+    } else if constexpr (rank == 2) {
+        Kokkos::parallel_for(name, Kokkos::RangePolicy<execution_space>(lo, hi),
+            [=](const int x) { row(x * stride[0], lo, hi); });
+    } else {
+        Kokkos::parallel_for(name, Kokkos::MDRangePolicy<execution_space, Kokkos::Rank<2>>(
+            {lo, lo}, {hi, hi}),
+            [=](const int x, const int y) { row(x * stride[0] + y * stride[1], lo, hi); });
+    }
+}
+
+/* Whether a kernel's stores should be streaming, as a tuning output.
+ * Streaming stores pay off once the output is too big to stay in cache
+ * until it is read again, so the size of the output relative to the last
+ * level cache (as a log2 class: 0 for about the LLC size, positive when
+ * bigger) is an input, and the default is to stream outputs bigger than
+ * the LLC. The mode is requested in a context of its own, nested in the
+ * fastest_of context of the variant, and the body is called with
+ * std::true_type to stream or std::false_type not to:
+ *
+ *   store_mode_tuner stores("3d_7point");
+ *   fastest_of(tuner, ..., [&]() {
+ *       stores(dest.span() * sizeof(double), [&](auto streaming) {
+ *           row_sweep<decltype(streaming)::value>("rows", source, dest, lo, hi, stencil);
+ *       });
+ *   });
+ */
+class store_mode_tuner {
+public:
+    enum mode { regular, streaming };
+
+    store_mode_tuner(const std::string& name) : llc_bytes_(Impl::last_level_cache_bytes()) {
+        std::vector<int64_t> modes{regular};
+        if (Impl::streaming_stores_supported) {
+            modes.push_back(streaming);
+        }
+        Kokkos::Tools::Experimental::VariableInfo out_info;
+        out_info.type = Kokkos::Tools::Experimental::ValueType::kokkos_value_int64;
+        out_info.category = Kokkos::Tools::Experimental::StatisticalCategory::kokkos_value_categorical;
+        out_info.valueQuantity = Kokkos::Tools::Experimental::CandidateValueType::kokkos_value_set;
+        out_info.candidates = Kokkos::Tools::Experimental::make_candidate_set(modes.size(), modes.data());
+        output_id_ = Kokkos::Tools::Experimental::declare_output_type(name + "_store_mode", out_info);
+    }
+
+    template<typename Body>
+    void operator()(const size_t output_bytes, Body body) {
+        Impl::tuning_scope scope(latch_);
+        // the input and the default depend on the size, so only when asking
+        if (!scope.latched()) {
+            const int64_t ratio_class = Impl::log2_class(output_bytes) - Impl::log2_class(llc_bytes_);
+            const int64_t fallback = Impl::streaming_stores_supported && output_bytes > llc_bytes_ ?
+                streaming : regular;
+            Kokkos::Tools::Experimental::VariableValue input =
+                Kokkos::Tools::Experimental::make_variable_value(Impl::llc_ratio_variable_id(), ratio_class);
+            answer_ = Kokkos::Tools::Experimental::make_variable_value(output_id_, fallback);
+            scope.request(&answer_, 1, &input, 1);
+        }
+        if (answer_.value.int_value == streaming) {
+            body(std::true_type{});
+        } else {
+            body(std::false_type{});
+        }
+    }
+
+private:
+    size_t llc_bytes_;
+    size_t output_id_;
+    Kokkos::Tools::Experimental::VariableValue answer_;
+    Impl::tuning_latch latch_;
+};
+
+#endif // STREAMINGSTORE_HPP
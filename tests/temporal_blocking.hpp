@@ -0,0 +1,194 @@
+#ifndef TEMPORALBLOCKING_HPP
+#define TEMPORALBLOCKING_HPP
+
+#include<tuning_playground.hpp>
+#include<search_space.hpp>
+#include<algorithm>
+#include<cmath>
+#include<string>
+#include<utility>
+#include<vector>
+
+/* Every stencil variant in the Jacobi tests advances the grid by this many
+ * timesteps per call, so that naive and temporally blocked variants do
+ * the same work and fastest_of can compare them. */
+constexpr int temporal_steps{4};
+
+namespace Impl {
+
+/* Reads the neighbours of one cell of a tile buffer: at(dx, dy, dz) is
+ * the cell at that offset. Unused trailing offsets default to 0. */
+struct tile_accessor {
+    const double* center;
+    int64_t stride[3];
+    KOKKOS_INLINE_FUNCTION double operator()(const int dx, const int dy = 0, const int dz = 0) const {
+        return center[dx * stride[0] + dy * stride[1] + dz * stride[2]];
+    }
+};
+
+// where cell (i, j, k) is in a tile buffer that starts at cell elo
+KOKKOS_INLINE_FUNCTION int64_t tile_offset(const int i, const int j, const int k,
+                                           const int elo[3], const int64_t stride[3]) {
+    return (i - elo[0]) * stride[0] + (j - elo[1]) * stride[1] + (k - elo[2]);
+}
+
+// access a rank 1, 2 or 3 View with three indices
+template<typename ViewType>
+KOKKOS_INLINE_FUNCTION typename ViewType::reference_type
+cell(const ViewType& view, const int i, const int j, const int k) {
+    if constexpr (ViewType::rank == 1) {
+        return view(i);
+    } else if constexpr (ViewType::rank == 2) {
+        return view(i, j);
+    } else {
+        return view(i, j, k);
+    }
+}
+
+/* One pass of overlapped (trapezoidal) temporal blocking: depth timesteps
+ * from source into dest. Every team takes one tile, copies it and a halo
+ * of depth cells into scratch memory, and advances it depth timesteps
+ * there, recomputing the shrinking halo instead of exchanging it. Only
+ * the tile itself is written back. The cells on the edge of the grid are
+ * never updated, like in the naive kernels. */
+template<typename ViewType, typename Stencil>
+void overlapped_tile_pass(const ViewType& source, const ViewType& dest, const int depth,
+                          const int tile, const Stencil& stencil) {
+    constexpr int rank = ViewType::rank;
+    using execution_space = typename ViewType::execution_space;
+    using team_policy = Kokkos::TeamPolicy<execution_space>;
+    using member_type = typename team_policy::member_type;
+    using scratch_view = Kokkos::View<double *, typename execution_space::scratch_memory_space,
+                                      Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+    int n[3] = {1, 1, 1};
+    int tiles[3] = {1, 1, 1};
+    int halo[3] = {0, 0, 0};
+    int64_t buffer_size{1};
+    int league_size{1};
+    for (int d = 0 ; d < rank ; d++) {
+        n[d] = source.extent_int(d);
+        tiles[d] = (n[d] + tile - 1) / tile;
+        halo[d] = depth;
+        buffer_size *= std::min(tile + 2 * depth, n[d]);
+        league_size *= tiles[d];
+    }
+    const auto policy = team_policy(league_size, 1).set_scratch_size(1,
+        Kokkos::PerTeam(2 * scratch_view::shmem_size(buffer_size)));
+    Kokkos::parallel_for("temporally blocked jacobi", policy,
+        KOKKOS_LAMBDA(const member_type& member) {
+            // this tile, and the part of the grid it needs, with its halo
+            int lo[3], hi[3], elo[3], ehi[3];
+            int rest = member.league_rank();
+            for (int d = 2 ; d >= 0 ; d--) {
+                lo[d] = (rest % tiles[d]) * tile;
+                hi[d] = Kokkos::min(lo[d] + tile, n[d]);
+                rest /= tiles[d];
+                elo[d] = Kokkos::max(lo[d] - halo[d], 0);
+                ehi[d] = Kokkos::min(hi[d] + halo[d], n[d]);
+            }
+            const int64_t stride[3] = {int64_t(ehi[1] - elo[1]) * (ehi[2] - elo[2]),
+                                       int64_t(ehi[2] - elo[2]), 1};
+            scratch_view first(member.team_scratch(1), buffer_size);
+            scratch_view second(member.team_scratch(1), buffer_size);
+            double* current = first.data();
+            double* next = second.data();
+            for (int i = elo[0] ; i < ehi[0] ; i++) {
+                for (int j = elo[1] ; j < ehi[1] ; j++) {
+                    for (int k = elo[2] ; k < ehi[2] ; k++) {
+                        current[tile_offset(i, j, k, elo, stride)] = cell(source, i, j, k);
+                    }
+                }
+            }
+            for (int step = 0 ; step < depth ; step++) {
+                // the cells still needed after this step
+                const int margin = depth - 1 - step;
+                int rlo[3], rhi[3];
+                for (int d = 0 ; d < 3 ; d++) {
+                    rlo[d] = d < rank ? Kokkos::max(lo[d] - margin, elo[d]) : 0;
+                    rhi[d] = d < rank ? Kokkos::min(hi[d] + margin, ehi[d]) : 1;
+                }
+                for (int i = rlo[0] ; i < rhi[0] ; i++) {
+                    for (int j = rlo[1] ; j < rhi[1] ; j++) {
+                        for (int k = rlo[2] ; k < rhi[2] ; k++) {
+                            const int64_t o = tile_offset(i, j, k, elo, stride);
+                            const bool edge = (i == 0 || i == n[0] - 1) ||
+                                (rank > 1 && (j == 0 || j == n[1] - 1)) ||
+                                (rank > 2 && (k == 0 || k == n[2] - 1));
+                            next[o] = edge ? current[o] :
+                                stencil(tile_accessor{current + o, {stride[0], stride[1], stride[2]}});
+                        }
+                    }
+                }
+                const auto swap = current;
+                current = next;
+                next = swap;
+            }
+            for (int i = lo[0] ; i < hi[0] ; i++) {
+                for (int j = lo[1] ; j < hi[1] ; j++) {
+                    for (int k = lo[2] ; k < hi[2] ; k++) {
+                        cell(dest, i, j, k) = current[tile_offset(i, j, k, elo, stride)];
+                    }
+                }
+            }
+        });
+}
+
+} // namespace Impl
+
+/* A temporally blocked Jacobi variant, to offer beside the naive kernel
+ * with fastest_of. Each call advances the grid temporal_steps timesteps,
+ * in passes of a tuned time-block depth, over tiles of a tuned size. The
+ * depth and tile are one search space, constrained so that a tile's two
+ * scratch buffers fit in L2 and the recomputed halo is at most as much
+ * work as the tile itself. They are requested in a context of their own,
+ * nested in the fastest_of context.
+ *
+ *   temporal_blocking blocked("3d_7point", 3, {8, 16, 32, 64});
+ *   fastest_of(tuner, [&]() { ...naive... },
+ *       [&]() { blocked(source, dest, stencil); });
+ *
+ * The stencil is called with an Impl::tile_accessor, like
+ * [](const auto& at) { return (at(-1) + at(0) + at(1)) / 3.0; } */
+class temporal_blocking {
+public:
+    temporal_blocking(const std::string& name, const int rank,
+                      const std::vector<int64_t>& tiles) {
+        const size_t l2_bytes = Impl::l2_cache_bytes();
+        d_depth_ = space_.add_dimension("depth", divisorsOf(temporal_steps));
+        d_tile_ = space_.add_dimension("tile", tiles);
+        const size_t depth = d_depth_, tile = d_tile_;
+        // the cells in a tile and its halo
+        const auto padded = [=](const search_space::point& p) {
+            return std::pow(double(p[tile] + 2 * p[depth]), rank);
+        };
+        space_.add_constraint("tile buffers fit in L2", [=](const search_space::point& p) {
+            return 2 * padded(p) * sizeof(double) <= l2_bytes;
+        });
+        space_.add_constraint("halo is at most the tile", [=](const search_space::point& p) {
+            return padded(p) <= 2 * std::pow(double(p[tile]), rank);
+        });
+        answer_vector_.push_back(Kokkos::Tools::Experimental::make_variable_value(
+            space_.declare_output(name + "_temporal_block"), int64_t(0)));
+    }
+
+    // advance source by temporal_steps timesteps, leaving the result in source
+    template<typename ViewType, typename Stencil>
+    void operator()(ViewType& source, ViewType& dest, const Stencil& stencil) {
+        Impl::tuning_scope scope(latch_, answer_vector_.data(), answer_vector_.size());
+        const search_space::point& point = space_.at(answer_vector_[0].value.int_value);
+        const int depth = point[d_depth_];
+        for (int step = 0 ; step < temporal_steps ; step += depth) {
+            Impl::overlapped_tile_pass(source, dest, depth, point[d_tile_], stencil);
+            std::swap(source, dest);
+        }
+    }
+
+private:
+    search_space space_;
+    size_t d_depth_;
+    size_t d_tile_;
+    std::vector<Kokkos::Tools::Experimental::VariableValue> answer_vector_;
+    Impl::tuning_latch latch_;
+};
+
+#endif // TEMPORALBLOCKING_HPP
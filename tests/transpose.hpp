@@ -0,0 +1,552 @@
+#ifndef TRANSPOSE_HPP
+#define TRANSPOSE_HPP
+
+#include<tuning_playground.hpp>
+#include<streaming_store.hpp>
+#include<algorithm>
+#include<iomanip>
+#include<iostream>
+#include<string>
+#include<type_traits>
+#include<vector>
+#if defined(__AVX__) || defined(__SSE__)
+#include<immintrin.h>
+#endif
+
+namespace Impl {
+
+constexpr int max_transpose_rank{8};
+
+/* A copy between two layouts of the same box, seen as a batch of 2D
+ * transposes: the rows dimension is unit-stride (or the smallest stride)
+ * in the source, the cols dimension in the destination, and every other
+ * dimension is a batch dimension, iterated over one slab at a time. */
+struct transpose_plan {
+    int64_t rows{1};
+    int64_t cols{1};
+    int64_t src_row_stride{0};
+    int64_t src_col_stride{0};
+    int64_t dst_row_stride{0};
+    int64_t dst_col_stride{0};
+    int batch_rank{0};
+    int64_t batch_extent[max_transpose_rank] = {};
+    int64_t src_batch_stride[max_transpose_rank] = {};
+    int64_t dst_batch_stride[max_transpose_rank] = {};
+
+    int64_t batch_size() const {
+        int64_t size{1};
+        for (int d = 0 ; d < batch_rank ; d++) {
+            size *= batch_extent[d];
+        }
+        return size;
+    }
+
+    // where slab b starts, in the source and the destination
+    KOKKOS_INLINE_FUNCTION void batch_offsets(int64_t b, int64_t& src, int64_t& dst) const {
+        src = 0;
+        dst = 0;
+        for (int d = 0 ; d < batch_rank ; d++) {
+            const int64_t i = b % batch_extent[d];
+            b /= batch_extent[d];
+            src += i * src_batch_stride[d];
+            dst += i * dst_batch_stride[d];
+        }
+    }
+
+    // the rank of the copy after collapsing, counting only extents over 1
+    int collapsed_rank() const {
+        int rank = (rows > 1) + (cols > 1);
+        for (int d = 0 ; d < batch_rank ; d++) {
+            rank += batch_extent[d] > 1;
+        }
+        return rank;
+    }
+
+    // true if the transposes can use contiguous vector loads and stores
+    bool unit_strides() const {
+        return src_row_stride == 1 && dst_col_stride == 1;
+    }
+};
+
+// one dimension of a copy: its extent, and its strides in both views
+struct copy_dimension {
+    int64_t extent;
+    int64_t src_stride;
+    int64_t dst_stride;
+};
+
+/* The dimensions of a copy in canonical form. A copy visits every element
+ * once in any order, so the dimensions can be permuted freely: those of
+ * extent 1 are dropped, the rest are sorted by source stride, and each is
+ * fused into the one before it when the pair is contiguous in both views.
+ * A LayoutLeft to LayoutRight copy reverses the order of the dimensions,
+ * so nothing fuses there, but subviews and matching layouts do. */
+template<typename DstType, typename SrcType>
+std::vector<copy_dimension> collapse_dimensions(const DstType& dst, const SrcType& src) {
+    std::vector<copy_dimension> dims;
+    for (unsigned d = 0 ; d < SrcType::rank ; d++) {
+        if (src.extent(d) > 1) {
+            dims.push_back({int64_t(src.extent(d)), int64_t(src.stride(d)), int64_t(dst.stride(d))});
+        }
+    }
+    std::stable_sort(dims.begin(), dims.end(), [](const copy_dimension& a, const copy_dimension& b) {
+        return a.src_stride < b.src_stride;
+    });
+    std::vector<copy_dimension> collapsed;
+    for (const copy_dimension& dim : dims) {
+        if (!collapsed.empty()) {
+            copy_dimension& inner = collapsed.back();
+            if (dim.src_stride == inner.src_stride * inner.extent &&
+                dim.dst_stride == inner.dst_stride * inner.extent) {
+                inner.extent *= dim.extent;
+                continue;
+            }
+        }
+        collapsed.push_back(dim);
+    }
+    return collapsed;
+}
+
+/* Plans a copy on its collapsed dimensions, so that a copy of any rank
+ * becomes at most a batch of 2D transposes: rows is the fastest dimension
+ * of the source, cols the fastest of the rest in the destination, and the
+ * others are batch dimensions, fastest in the source first. */
+template<typename DstType, typename SrcType>
+transpose_plan plan_transpose(const DstType& dst, const SrcType& src) {
+    static_assert(int(DstType::rank) == int(SrcType::rank), "transpose needs views of the same rank");
+    static_assert(SrcType::rank <= max_transpose_rank, "transpose supports up to rank 8");
+    for (unsigned d = 0 ; d < SrcType::rank ; d++) {
+        if (dst.extent(d) != src.extent(d)) {
+            Kokkos::abort("transpose: the views have different extents");
+        }
+    }
+    transpose_plan plan;
+    if (src.size() == 0) {
+        plan.rows = 0;
+        return plan;
+    }
+    std::vector<copy_dimension> dims = collapse_dimensions(dst, src);
+    if (dims.empty()) {
+        return plan;
+    }
+    plan.rows = dims[0].extent;
+    plan.src_row_stride = dims[0].src_stride;
+    plan.dst_row_stride = dims[0].dst_stride;
+    dims.erase(dims.begin());
+    if (dims.empty()) {
+        return plan;
+    }
+    const auto col = std::min_element(dims.begin(), dims.end(),
+        [](const copy_dimension& a, const copy_dimension& b) { return a.dst_stride < b.dst_stride; });
+    plan.cols = col->extent;
+    plan.src_col_stride = col->src_stride;
+    plan.dst_col_stride = col->dst_stride;
+    dims.erase(col);
+    for (const copy_dimension& dim : dims) {
+        plan.batch_extent[plan.batch_rank] = dim.extent;
+        plan.src_batch_stride[plan.batch_rank] = dim.src_stride;
+        plan.dst_batch_stride[plan.batch_rank] = dim.dst_stride;
+        plan.batch_rank++;
+    }
+    return plan;
+}
+
+/* Copy the rows [r0, r1) x cols [c0, c1) block of one slab. Streaming
+ * stores go along the destination's contiguous cols, so that they fill
+ * whole lines; regular ones along the source's rows. */
+template<bool Streaming = false, typename Scalar>
+KOKKOS_INLINE_FUNCTION void transpose_block(const transpose_plan& plan, const Scalar* src,
+                                            Scalar* dst, const int64_t r0, const int64_t r1,
+                                            const int64_t c0, const int64_t c1) {
+    if constexpr (Streaming) {
+        for (int64_t r = r0 ; r < r1 ; r++) {
+            for (int64_t c = c0 ; c < c1 ; c++) {
+                store<true>(dst + r * plan.dst_row_stride + c * plan.dst_col_stride,
+                            src[r * plan.src_row_stride + c * plan.src_col_stride]);
+            }
+        }
+    } else {
+        for (int64_t c = c0 ; c < c1 ; c++) {
+            for (int64_t r = r0 ; r < r1 ; r++) {
+                dst[r * plan.dst_row_stride + c * plan.dst_col_stride] =
+                    src[r * plan.src_row_stride + c * plan.src_col_stride];
+            }
+        }
+    }
+}
+
+/* Cache-oblivious: halve the longer side of the block until both fit in
+ * the leaf size, so every level of the cache hierarchy sees blocks that
+ * fit it at some depth of the recursion. */
+template<typename Scalar>
+void transpose_recursive(const transpose_plan& plan, const Scalar* src, Scalar* dst,
+                         const int64_t r0, const int64_t r1, const int64_t c0, const int64_t c1,
+                         const int64_t leaf) {
+    if (r1 - r0 <= leaf && c1 - c0 <= leaf) {
+        transpose_block(plan, src, dst, r0, r1, c0, c1);
+    } else if (r1 - r0 >= c1 - c0) {
+        const int64_t middle = r0 + (r1 - r0) / 2;
+        transpose_recursive(plan, src, dst, r0, middle, c0, c1, leaf);
+        transpose_recursive(plan, src, dst, middle, r1, c0, c1, leaf);
+    } else {
+        const int64_t middle = c0 + (c1 - c0) / 2;
+        transpose_recursive(plan, src, dst, r0, r1, c0, middle, leaf);
+        transpose_recursive(plan, src, dst, r0, r1, middle, c1, leaf);
+    }
+}
+
+/* The width of the in-register transpose for floats: 8x8 with AVX, 4x4
+ * with SSE, and 0 (scalar only) otherwise. */
+#if defined(__AVX__)
+constexpr int simd_transpose_width{8};
+#elif defined(__SSE__)
+constexpr int simd_transpose_width{4};
+#else
+constexpr int simd_transpose_width{0};
+#endif
+
+/* Transposes one width x width block of floats in registers: loads
+ * width columns of the source (contiguous along rows) and stores width
+ * rows of the destination (contiguous along cols). The stores are
+ * streaming if Streaming and the destination rows are aligned. */
+template<bool Streaming = false>
+inline void transpose_in_registers(const float* src, const int64_t src_col_stride,
+                                   float* dst, const int64_t dst_row_stride) {
+#if defined(__AVX__)
+    const auto store_row = [](float* address, const __m256 row) {
+        if (Streaming && reinterpret_cast<uintptr_t>(address) % 32 == 0) {
+            _mm256_stream_ps(address, row);
+        } else {
+            _mm256_storeu_ps(address, row);
+        }
+    };
+    __m256 r0 = _mm256_loadu_ps(src + 0 * src_col_stride);
+    __m256 r1 = _mm256_loadu_ps(src + 1 * src_col_stride);
+    __m256 r2 = _mm256_loadu_ps(src + 2 * src_col_stride);
+    __m256 r3 = _mm256_loadu_ps(src + 3 * src_col_stride);
+    __m256 r4 = _mm256_loadu_ps(src + 4 * src_col_stride);
+    __m256 r5 = _mm256_loadu_ps(src + 5 * src_col_stride);
+    __m256 r6 = _mm256_loadu_ps(src + 6 * src_col_stride);
+    __m256 r7 = _mm256_loadu_ps(src + 7 * src_col_stride);
+    const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    const __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+    const __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+    const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    const __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+    const __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+    const __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+    const __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+    const __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+    r0 = _mm256_permute2f128_ps(s0, s4, 0x20);
+    r1 = _mm256_permute2f128_ps(s1, s5, 0x20);
+    r2 = _mm256_permute2f128_ps(s2, s6, 0x20);
+    r3 = _mm256_permute2f128_ps(s3, s7, 0x20);
+    r4 = _mm256_permute2f128_ps(s0, s4, 0x31);
+    r5 = _mm256_permute2f128_ps(s1, s5, 0x31);
+    r6 = _mm256_permute2f128_ps(s2, s6, 0x31);
+    r7 = _mm256_permute2f128_ps(s3, s7, 0x31);
+    store_row(dst + 0 * dst_row_stride, r0);
+    store_row(dst + 1 * dst_row_stride, r1);
+    store_row(dst + 2 * dst_row_stride, r2);
+    store_row(dst + 3 * dst_row_stride, r3);
+    store_row(dst + 4 * dst_row_stride, r4);
+    store_row(dst + 5 * dst_row_stride, r5);
+    store_row(dst + 6 * dst_row_stride, r6);
+    store_row(dst + 7 * dst_row_stride, r7);
+#elif defined(__SSE__)
+    __m128 r0 = _mm_loadu_ps(src + 0 * src_col_stride);
+    __m128 r1 = _mm_loadu_ps(src + 1 * src_col_stride);
+    __m128 r2 = _mm_loadu_ps(src + 2 * src_col_stride);
+    __m128 r3 = _mm_loadu_ps(src + 3 * src_col_stride);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    const auto store_row = [](float* address, const __m128 row) {
+        if (Streaming && reinterpret_cast<uintptr_t>(address) % 16 == 0) {
+            _mm_stream_ps(address, row);
+        } else {
+            _mm_storeu_ps(address, row);
+        }
+    };
+    store_row(dst + 0 * dst_row_stride, r0);
+    store_row(dst + 1 * dst_row_stride, r1);
+    store_row(dst + 2 * dst_row_stride, r2);
+    store_row(dst + 3 * dst_row_stride, r3);
+#else
+    (void)src; (void)src_col_stride; (void)dst; (void)dst_row_stride;
+#endif
+}
+
+/* A block of floats, in width x width register transposes, with the
+ * edges that don't fill a register done by the scalar loop. */
+template<bool Streaming = false, typename Scalar>
+void transpose_block_simd(const transpose_plan& plan, const Scalar* src, Scalar* dst,
+                          const int64_t r0, const int64_t r1, const int64_t c0, const int64_t c1) {
+    constexpr int width = std::is_same<Scalar, float>::value ? simd_transpose_width : 0;
+    if (width == 0 || !plan.unit_strides()) {
+        transpose_block<Streaming>(plan, src, dst, r0, r1, c0, c1);
+        return;
+    }
+    const int64_t r_end = r0 + (r1 - r0) / width * width;
+    const int64_t c_end = c0 + (c1 - c0) / width * width;
+    if constexpr (width > 0) {
+        for (int64_t c = c0 ; c < c_end ; c += width) {
+            for (int64_t r = r0 ; r < r_end ; r += width) {
+                transpose_in_registers<Streaming>(src + r + c * plan.src_col_stride, plan.src_col_stride,
+                                       dst + r * plan.dst_row_stride + c, plan.dst_row_stride);
+            }
+        }
+    }
+    transpose_block<Streaming>(plan, src, dst, r_end, r1, c0, c_end);
+    transpose_block<Streaming>(plan, src, dst, r0, r1, c_end, c1);
+}
+
+/* A block size, tuned in a context of its own nested in the fastest_of
+ * context of the variant that uses it. */
+class transpose_block_tuner {
+public:
+    transpose_block_tuner(const std::string& name) {
+        Kokkos::Tools::Experimental::VariableInfo out_info;
+        out_info.type = Kokkos::Tools::Experimental::ValueType::kokkos_value_int64;
+        out_info.category = Kokkos::Tools::Experimental::StatisticalCategory::kokkos_value_ordinal;
+        out_info.valueQuantity = Kokkos::Tools::Experimental::CandidateValueType::kokkos_value_set;
+        out_info.candidates = Kokkos::Tools::Experimental::make_candidate_set(
+            candidates_.size(), candidates_.data());
+        answer_.push_back(Kokkos::Tools::Experimental::make_variable_value(
+            Kokkos::Tools::Experimental::declare_output_type(name, out_info), int64_t(32)));
+    }
+
+    // call body with the block size to use
+    template<typename Body>
+    void operator()(Body body) {
+        Impl::tuning_scope scope(latch_, answer_.data(), answer_.size());
+        body(answer_[0].value.int_value);
+    }
+
+    const std::vector<int64_t>& candidates() const { return candidates_; }
+
+private:
+    // multiples of 8, so the register transposes tile every block
+    std::vector<int64_t> candidates_{8, 16, 32, 64, 128};
+    std::vector<Kokkos::Tools::Experimental::VariableValue> answer_;
+    Impl::tuning_latch latch_;
+};
+
+} // namespace Impl
+
+/* An in-repo engine for copies between two layouts of the same box,
+ * like Kokkos::deep_copy from LayoutLeft to LayoutRight, which is a
+ * rank-N transpose. It has three variants, each with its own tuned block
+ * size, to offer beside deep_copy with fastest_of:
+ *
+ *  - blocked: block x block tiles of every slab, one tile per work item
+ *  - recursive: cache-oblivious halving, down to block x block leaves
+ *  - simd: blocked, with 8x8 (AVX) or 4x4 (SSE) in-register transposes
+ *    of floats, and the scalar loop for the edges and other types
+ *
+ * blocked and simd also have a tuned store mode (see store_mode_tuner):
+ * streaming stores skip reading the destination lines before writing
+ * them, which pays off once the destination outgrows the last level
+ * cache.
+ *
+ *   transpose_engine engine("deep_copy_3");
+ *   fastest_of(tuner, [&]() { Kokkos::deep_copy(right, left); },
+ *       [&]() { engine.blocked(right, left); }, ...);
+ *
+ * Like deep_copy, the destination comes first. The views have to be
+ * host accessible, so where they may be in device memory, offer the
+ * engine through Impl::on_host and fall back to deep_copy. */
+class transpose_engine {
+public:
+    using host_space = Kokkos::DefaultHostExecutionSpace;
+
+    transpose_engine(const std::string& name) :
+        blocked_block_(name + "_blocked_block"),
+        recursive_leaf_(name + "_recursive_leaf"),
+        simd_block_(name + "_simd_block"),
+        blocked_stores_(name + "_blocked"),
+        simd_stores_(name + "_simd") {}
+
+    template<typename DstType, typename SrcType>
+    void blocked(const DstType& dst, const SrcType& src) {
+        blocked_block_([&](const int64_t block) {
+            blocked_stores_(bytes_of(dst), [&](auto streaming) {
+                run_blocked<decltype(streaming)::value>(dst, src, block);
+            });
+        });
+    }
+
+    template<typename DstType, typename SrcType>
+    void recursive(const DstType& dst, const SrcType& src) {
+        recursive_leaf_([&](const int64_t leaf) { run_recursive(dst, src, leaf); });
+    }
+
+    template<typename DstType, typename SrcType>
+    void simd(const DstType& dst, const SrcType& src) {
+        simd_block_([&](const int64_t block) {
+            simd_stores_(bytes_of(dst), [&](auto streaming) {
+                run_simd<decltype(streaming)::value>(dst, src, block);
+            });
+        });
+    }
+
+    // the untuned forms, for reporting every block size and store mode
+    template<bool Streaming = false, typename DstType, typename SrcType>
+    static void run_blocked(const DstType& dst, const SrcType& src, const int64_t block) {
+        tiled(dst, src, block, "transpose blocked", [](const Impl::transpose_plan& plan,
+              const auto* from, auto* to, int64_t r0, int64_t r1, int64_t c0, int64_t c1) {
+            Impl::transpose_block<Streaming>(plan, from, to, r0, r1, c0, c1);
+            Impl::store_fence<Streaming>();
+        });
+    }
+
+    template<typename DstType, typename SrcType>
+    static void run_recursive(const DstType& dst, const SrcType& src, const int64_t leaf) {
+        // recursion starts from chunks this big, so there is parallelism
+        constexpr int64_t chunk{512};
+        tiled(dst, src, chunk, "transpose recursive", [leaf](const Impl::transpose_plan& plan,
+              const auto* from, auto* to, int64_t r0, int64_t r1, int64_t c0, int64_t c1) {
+            Impl::transpose_recursive(plan, from, to, r0, r1, c0, c1, leaf);
+        });
+    }
+
+    template<bool Streaming = false, typename DstType, typename SrcType>
+    static void run_simd(const DstType& dst, const SrcType& src, const int64_t block) {
+        tiled(dst, src, block, "transpose simd", [](const Impl::transpose_plan& plan,
+              const auto* from, auto* to, int64_t r0, int64_t r1, int64_t c0, int64_t c1) {
+            Impl::transpose_block_simd<Streaming>(plan, from, to, r0, r1, c0, c1);
+            Impl::store_fence<Streaming>();
+        });
+    }
+
+    const std::vector<int64_t>& block_sizes() const { return blocked_block_.candidates(); }
+
+private:
+    template<typename ViewType>
+    static size_t bytes_of(const ViewType& view) {
+        return view.span() * sizeof(typename ViewType::value_type);
+    }
+
+    // one work item per block x block tile of every slab
+    template<typename DstType, typename SrcType, typename Body>
+    static void tiled(const DstType& dst, const SrcType& src, const int64_t block,
+                      const std::string& label, const Body& body) {
+        static_assert(Kokkos::SpaceAccessibility<host_space, typename SrcType::memory_space>::accessible &&
+                      Kokkos::SpaceAccessibility<host_space, typename DstType::memory_space>::accessible,
+                      "transpose_engine runs on the host, so its views have to be host accessible");
+        const Impl::transpose_plan plan = Impl::plan_transpose(dst, src);
+        const int64_t row_tiles = (plan.rows + block - 1) / block;
+        const int64_t col_tiles = (plan.cols + block - 1) / block;
+        const auto from = src.data();
+        const auto to = dst.data();
+        Kokkos::parallel_for(label, Kokkos::RangePolicy<host_space>(0, plan.batch_size() * row_tiles * col_tiles),
+            KOKKOS_LAMBDA(const int64_t index) {
+                const int64_t r0 = (index % row_tiles) * block;
+                const int64_t c0 = ((index / row_tiles) % col_tiles) * block;
+                int64_t src_offset, dst_offset;
+                plan.batch_offsets(index / (row_tiles * col_tiles), src_offset, dst_offset);
+                body(plan, from + src_offset, to + dst_offset,
+                     r0, std::min(r0 + block, plan.rows), c0, std::min(c0 + block, plan.cols));
+            });
+        host_space().fence();
+    }
+
+    Impl::transpose_block_tuner blocked_block_;
+    Impl::transpose_block_tuner recursive_leaf_;
+    Impl::transpose_block_tuner simd_block_;
+    store_mode_tuner blocked_stores_;
+    store_mode_tuner simd_stores_;
+};
+
+/* A copy between two layouts of the same box, like Kokkos::deep_copy,
+ * but on the collapsed plan: one Rank<3> MDRange over (slab, col, row),
+ * whatever the rank of the views. With --kokkos-tune-internals, deep_copy
+ * tunes a tile size per dimension of its rank-N MDRange, a space too big
+ * for exhaustive search from rank 4 up; this one tunes three. */
+template<typename DstType, typename SrcType>
+void collapsed_copy(const DstType& dst, const SrcType& src) {
+    using host_space = Kokkos::DefaultHostExecutionSpace;
+    static_assert(Kokkos::SpaceAccessibility<host_space, typename SrcType::memory_space>::accessible &&
+                  Kokkos::SpaceAccessibility<host_space, typename DstType::memory_space>::accessible,
+                  "collapsed_copy runs on the host, so its views have to be host accessible");
+    const Impl::transpose_plan plan = Impl::plan_transpose(dst, src);
+    const auto from = src.data();
+    const auto to = dst.data();
+    Kokkos::parallel_for("collapsed copy", Kokkos::MDRangePolicy<host_space, Kokkos::Rank<3>,
+        Kokkos::IndexType<int64_t>>({0, 0, 0}, {plan.batch_size(), plan.cols, plan.rows}),
+        KOKKOS_LAMBDA(const int64_t b, const int64_t c, const int64_t r) {
+            int64_t src_offset, dst_offset;
+            plan.batch_offsets(b, src_offset, dst_offset);
+            to[dst_offset + r * plan.dst_row_stride + c * plan.dst_col_stride] =
+                from[src_offset + r * plan.src_row_stride + c * plan.src_col_stride];
+        });
+    host_space().fence();
+}
+
+/* Prints the effective bandwidth (bytes read plus bytes written per
+ * second) of deep_copy, the collapsed copy and every engine variant at
+ * every block size and store mode, against a STREAM-style copy of the
+ * same number of contiguous values, which is as fast as a copy between
+ * these views could be. From rank 4 up deep_copy is left out: a few calls
+ * would leave its rank-N tile search unconverged. Like the engine, this
+ * needs host accessible views. */
+template<typename DstType, typename SrcType>
+void transpose_report(const std::string& name, transpose_engine& engine,
+                      const DstType& dst, const SrcType& src) {
+    using value_type = typename SrcType::non_const_value_type;
+    constexpr int calls{20};
+    const size_t count = src.size();
+    const double bytes = 2.0 * count * sizeof(value_type);
+    // the best of calls runs, after a warm up run
+    const auto gbs = [&](const auto& copy) {
+        copy();
+        double best{0.0};
+        for (int i = 0 ; i < calls ; i++) {
+            Kokkos::Timer timer;
+            copy();
+            Kokkos::fence();
+            best = std::max(best, bytes / timer.seconds() * 1.0e-9);
+        }
+        return best;
+    };
+    Kokkos::View<value_type *, Kokkos::HostSpace> stream_src("stream source", count);
+    Kokkos::View<value_type *, Kokkos::HostSpace> stream_dst("stream destination", count);
+    const double ceiling = gbs([&]() {
+        Kokkos::parallel_for("stream copy",
+            Kokkos::RangePolicy<Kokkos::DefaultHostExecutionSpace>(0, count),
+            KOKKOS_LAMBDA(const size_t i) { stream_dst(i) = stream_src(i); });
+    });
+    const auto flags = std::cout.flags();
+    const auto precision = std::cout.precision();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << name << ", rank " << SrcType::rank << " collapsed to "
+              << Impl::plan_transpose(dst, src).collapsed_rank() << ": STREAM copy " << ceiling << " GB/s" << std::endl;
+    const auto line = [&](const std::string& variant, const double rate) {
+        std::cout << "  " << std::setw(20) << std::left << variant << std::right
+                  << std::setw(10) << rate << " GB/s, "
+                  << 100.0 * rate / ceiling << "% of STREAM" << std::endl;
+    };
+    if (SrcType::rank <= 3) {
+        line("deep_copy", gbs([&]() { Kokkos::deep_copy(Kokkos::DefaultExecutionSpace{}, dst, src); }));
+    }
+    line("collapsed", gbs([&]() { collapsed_copy(dst, src); }));
+    for (const int64_t block : engine.block_sizes()) {
+        const std::string suffix{" " + std::to_string(block)};
+        line("blocked" + suffix, gbs([&]() { engine.run_blocked(dst, src, block); }));
+        line("recursive" + suffix, gbs([&]() { engine.run_recursive(dst, src, block); }));
+        line("simd" + suffix, gbs([&]() { engine.run_simd(dst, src, block); }));
+        if (Impl::streaming_stores_supported) {
+            line("blocked nt" + suffix, gbs([&]() { engine.run_blocked<true>(dst, src, block); }));
+            line("simd nt" + suffix, gbs([&]() { engine.run_simd<true>(dst, src, block); }));
+        }
+    }
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+#endif // TRANSPOSE_HPP
@@ -4,29 +4,313 @@
 #include<Kokkos_Core.hpp>
 #include<unordered_map>
 #include<iostream>
+#include<algorithm>
+#include<atomic>
+#include<cmath>
+#include<cstdlib>
+#include<fstream>
+#include<functional>
+#include<map>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<tuple>
+#include<type_traits>
+#include<utility>
+#include<vector>
 #include<Kokkos_Profiling_ScopedRegion.hpp>
 
 namespace Impl {
 
 constexpr const int max_iterations{1000};
 
+/* The Kokkos tuning interface (and the tool behind it) is not safe to call
+ * from several host threads at once, so every call the playground makes
+ * into it goes through this lock. Kernels are never run while holding it. */
+inline std::mutex& tuning_api_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// read an integer setting from the environment
+inline int64_t env_setting(const char* name, const int64_t fallback) {
+  const char* value{getenv(name)};
+  if (value == nullptr) {
+    return fallback;
+  }
+  return std::strtoll(value, nullptr, 10);
+}
+
+// read a floating point setting from the environment
+inline double env_setting_double(const char* name, const double fallback) {
+  const char* value{getenv(name)};
+  if (value == nullptr) {
+    return fallback;
+  }
+  return std::strtod(value, nullptr);
+}
+
+// whether host threads can work on Views in MemorySpace directly
+template<typename MemorySpace>
+constexpr bool host_accessible{
+  Kokkos::SpaceAccessibility<Kokkos::DefaultHostExecutionSpace, MemorySpace>::accessible};
+
+/* Calls body with std::true_type if host threads can work on Views in
+ * MemorySpace, and with std::false_type if not (on GPU builds). The
+ * variants that only run on the host go in the true branch of an
+ * if constexpr in body, so that they are never instantiated otherwise:
+ *
+ *   Impl::on_host<view_type::memory_space>([&](auto host) {
+ *       if constexpr (decltype(host)::value) {
+ *           fastest_of(tuner, portable, host_only);
+ *       } else {
+ *           fastest_of(tuner, portable);
+ *       }
+ *   });
+ */
+template<typename MemorySpace, typename Body>
+void on_host(Body&& body) {
+  body(std::integral_constant<bool, host_accessible<MemorySpace>>{});
+}
+
+/* While a benchmark iteration runs, fastest_of notes which implementation
+ * each call site picked, so the timing can be filed under it. Only the
+ * label's address and the index are noted during the iteration; they are
+ * formatted after it, outside the timed region, so the label has to
+ * outlive the iteration. */
+struct dispatch_log {
+  bool recording{false};
+  std::vector<std::pair<const std::string*, int64_t>> entries;
+
+  // "label=index,..." in the order the call sites were first seen
+  std::string configuration() const {
+    std::string configuration;
+    for (const auto& entry : entries) {
+      if (!configuration.empty()) {
+        configuration += ",";
+      }
+      configuration += *entry.first + "=" + std::to_string(entry.second);
+    }
+    return configuration;
+  }
+};
+
+inline dispatch_log& current_dispatch_log() {
+  static thread_local dispatch_log log;
+  return log;
+}
+
+inline void log_dispatch(const std::string& label, const int64_t which) {
+  dispatch_log& log = current_dispatch_log();
+  if (!log.recording) {
+    return;
+  }
+  for (const auto& entry : log.entries) {
+    if (entry.first == &label && entry.second == which) {
+      return;
+    }
+  }
+  log.entries.emplace_back(&label, which);
+}
+
+/* Summary statistics of a set of iteration times. Percentiles use all the
+ * samples; the mean and its 95% confidence interval use the samples left
+ * after rejecting outliers more than 3 scaled MADs from the median. */
+struct sample_statistics {
+  size_t samples{0};
+  size_t rejected{0};
+  double median{0.0};
+  double p95{0.0};
+  double p99{0.0};
+  double mean{0.0};
+  double ci95{0.0};
+};
+
+// nearest-rank percentile of sorted values
+inline double percentile(const std::vector<double>& sorted, const double fraction) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  const size_t rank = std::ceil(fraction * sorted.size());
+  return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+inline sample_statistics summarize(std::vector<double> times) {
+  sample_statistics stats;
+  stats.samples = times.size();
+  if (times.empty()) {
+    return stats;
+  }
+  std::sort(times.begin(), times.end());
+  stats.median = percentile(times, 0.5);
+  stats.p95 = percentile(times, 0.95);
+  stats.p99 = percentile(times, 0.99);
+  std::vector<double> deviations;
+  for (const double t : times) {
+    deviations.push_back(std::fabs(t - stats.median));
+  }
+  std::sort(deviations.begin(), deviations.end());
+  // 1.4826 scales the MAD to a standard deviation for normal data
+  const double limit = 3.0 * 1.4826 * percentile(deviations, 0.5);
+  double sum{0.0}, sum_squares{0.0};
+  size_t kept{0};
+  for (const double t : times) {
+    if (limit > 0.0 && std::fabs(t - stats.median) > limit) {
+      stats.rejected++;
+      continue;
+    }
+    sum += t;
+    sum_squares += t * t;
+    kept++;
+  }
+  stats.mean = sum / kept;
+  if (kept > 1) {
+    const double variance = std::max(0.0, (sum_squares - sum * stats.mean) / (kept - 1));
+    stats.ci95 = 1.96 * std::sqrt(variance / kept);
+  }
+  return stats;
+}
+
+/* The benchmark harness. run() calls the body once per iteration with
+ * fences around it, times every iteration, and files the time under the
+ * configuration that ran it - either set by the body with
+ * configuration(), or the implementations fastest_of picked.
+ *
+ * The first PLAYGROUND_BENCH_WARMUP iterations (default 5) are not
+ * counted. If PLAYGROUND_BENCH_RTOL is set, the run stops early once the
+ * 95% confidence interval of the current configuration's mean is within
+ * that fraction of the mean (default 0, run every iteration - the tuner
+ * needs them). At the end, the statistics of all the iterations and of
+ * the best configuration are printed, and if PLAYGROUND_BENCH_OUTPUT names
+ * a file, one record per configuration is appended to it: CSV if the name
+ * ends in .csv, JSON lines otherwise. */
+class benchmark {
+public:
+  explicit benchmark(const std::string& name) :
+    name_(name),
+    warmup_(std::max<int64_t>(0, env_setting("PLAYGROUND_BENCH_WARMUP", 5))),
+    relative_tolerance_(env_setting_double("PLAYGROUND_BENCH_RTOL", 0.0)) {}
+
+  // name the configuration the current iteration is running
+  void configuration(const std::string& configuration) {
+    configuration_ = configuration;
+  }
+
+  template<typename Body>
+  void run(const int num_iters, Body body) {
+    dispatch_log& log = current_dispatch_log();
+    int iterations{0};
+    for (int i = 0 ; i < num_iters ; i++) {
+      configuration_.clear();
+      log.entries.clear();
+      log.recording = true;
+      Kokkos::fence("benchmark: before iteration");
+      Kokkos::Timer timer;
+      body(i);
+      Kokkos::fence("benchmark: after iteration");
+      const double seconds = timer.seconds();
+      log.recording = false;
+      iterations++;
+      if (i < warmup_) {
+        continue;
+      }
+      const std::string configuration =
+          configuration_.empty() ? log.configuration() : configuration_;
+      auto& samples = samples_[configuration];
+      samples.push_back(seconds);
+      all_.push_back(seconds);
+      if (relative_tolerance_ > 0.0 && samples.size() >= min_samples &&
+          samples.size() % 10 == 0) {
+        const sample_statistics stats = summarize(samples);
+        if (stats.ci95 < relative_tolerance_ * stats.mean) {
+          break;
+        }
+      }
+    }
+    report(iterations);
+  }
+
+private:
+  void report(const int iterations) {
+    const sample_statistics all = summarize(all_);
+    print("all", all);
+    std::string best;
+    double best_median{0.0};
+    for (const auto& samples : samples_) {
+      const double median = summarize(samples.second).median;
+      if (best.empty() || median < best_median) {
+        best = samples.first;
+        best_median = median;
+      }
+    }
+    if (samples_.size() > 1 || !best.empty()) {
+      print("best: " + (best.empty() ? std::string("default") : best),
+            summarize(samples_[best]));
+    }
+    std::cout << "Benchmark " << name_ << ": " << iterations << " iterations, "
+              << samples_.size() << " configurations" << std::endl;
+    const char* output{getenv("PLAYGROUND_BENCH_OUTPUT")};
+    if (output == nullptr) {
+      return;
+    }
+    const std::string path{output};
+    const bool csv = path.size() > 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    const bool empty = !std::ifstream(path).good() ||
+        std::ifstream(path, std::ios::ate).tellg() == 0;
+    std::ofstream out(path, std::ios::app);
+    if (csv && empty) {
+      out << "benchmark,configuration,samples,rejected,median,p95,p99,mean,ci95" << std::endl;
+    }
+    for (const auto& samples : samples_) {
+      const sample_statistics stats = summarize(samples.second);
+      if (csv) {
+        out << name_ << ",\"" << samples.first << "\"," << stats.samples << ","
+            << stats.rejected << "," << stats.median << "," << stats.p95 << ","
+            << stats.p99 << "," << stats.mean << "," << stats.ci95 << std::endl;
+      } else {
+        out << "{\"benchmark\": \"" << name_ << "\", \"configuration\": \""
+            << samples.first << "\", \"samples\": " << stats.samples
+            << ", \"rejected\": " << stats.rejected << ", \"median\": " << stats.median
+            << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99
+            << ", \"mean\": " << stats.mean << ", \"ci95\": " << stats.ci95
+            << "}" << std::endl;
+      }
+    }
+  }
+
+  void print(const std::string& what, const sample_statistics& stats) const {
+    std::cout << "Benchmark " << name_ << " [" << what << "]: "
+              << stats.samples << " samples (" << stats.rejected << " rejected), median "
+              << stats.median << " s, p95 " << stats.p95 << " s, p99 " << stats.p99
+              << " s, mean " << stats.mean << " +/- " << stats.ci95 << " s" << std::endl;
+  }
+
+  static constexpr size_t min_samples{20};
+  const std::string name_;
+  const int64_t warmup_;
+  const double relative_tolerance_;
+  std::string configuration_;
+  std::map<std::string, std::vector<double>> samples_;
+  std::vector<double> all_;
+};
+
 struct empty {};
 
 template <typename Tunable, template <typename...> typename TupleLike,
           typename... Components, size_t... Indices>
-void invoke_benchmark_helper(const Tunable &tunable, int num_iters,
+void invoke_benchmark_helper(benchmark &bench, const Tunable &tunable, int num_iters,
                              const TupleLike<Components...> &tup,
                              const std::index_sequence<Indices...>) {
-  for (int x = 0; x < num_iters; ++x) {
+  bench.run(num_iters, [&](const int x) {
     tunable(x, num_iters, std::get<Indices>(tup)...);
-  }
+  });
 }
 
 template <typename Tunable, template <typename...> typename TupleLike,
           typename... Components>
-void invoke_benchmark(const Tunable &tunable, int num_iters,
+void invoke_benchmark(benchmark &bench, const Tunable &tunable, int num_iters,
                       const TupleLike<Components...> &tup) {
-  invoke_benchmark_helper(tunable, num_iters, tup,
+  invoke_benchmark_helper(bench, tunable, num_iters, tup,
                           std::make_index_sequence<sizeof...(Components)>{});
 }
 
@@ -40,6 +324,132 @@ auto setup_helper(const Setup &setup, int num_iters, std::true_type) {
   return std::make_tuple();
 }
 
+/* Latches a tuning decision once it has converged, so that a hot loop can
+ * skip the tuning API and dispatch straight to the last answer.
+ *
+ * Once the tool has handed back the same output values for
+ * PLAYGROUND_LATCH_WINDOW consecutive requests, use_latched() returns true
+ * for all but one in every PLAYGROUND_LATCH_PERIOD calls. Those sampled
+ * calls go through the tuning API again, and if the answer changed the
+ * latch is released. The window should be larger than the tool's own
+ * repetition window (APEX_KOKKOS_TUNING_WINDOW). Latching is off unless
+ * PLAYGROUND_LATCH_WINDOW is set. Only int64 and double outputs are
+ * compared. */
+class tuning_latch {
+public:
+  tuning_latch() :
+    window_(env_setting("PLAYGROUND_LATCH_WINDOW", 0)),
+    period_(std::max<int64_t>(1, env_setting("PLAYGROUND_LATCH_PERIOD", 1000))) {}
+
+  // true if this call may reuse the last answer without asking the tool
+  bool use_latched() {
+    if (!latched_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    return (calls_.fetch_add(1, std::memory_order_relaxed) + 1) % period_ != 0;
+  }
+
+  // record the answer from request_output_values
+  void observe(const Kokkos::Tools::Experimental::VariableValue* answers,
+               const size_t count) {
+    if (window_ <= 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool same = (last_.size() == count);
+    for (size_t i = 0 ; same && i < count ; i++) {
+      same = (last_[i] == answers[i].value.int_value);
+    }
+    if (!same) {
+      last_.clear();
+      for (size_t i = 0 ; i < count ; i++) {
+        last_.push_back(answers[i].value.int_value);
+      }
+      streak_ = 1;
+      latched_.store(false, std::memory_order_release);
+    } else if (++streak_ >= window_) {
+      latched_.store(true, std::memory_order_release);
+    }
+  }
+
+  bool latched() const { return latched_.load(std::memory_order_acquire); }
+
+private:
+  const int64_t window_;
+  const int64_t period_;
+  std::atomic<bool> latched_{false};
+  std::atomic<int64_t> calls_{0};
+  std::mutex mutex_;
+  // the raw bits of the last answer (int_value aliases double_value)
+  std::vector<int64_t> last_;
+  int64_t streak_{0};
+};
+
+/* One latched tuning request, open for the length of a scope: unless the
+ * latch says to reuse its answer, it opens a context, sets the inputs,
+ * requests the outputs into answers and shows them to the latch, and the
+ * context is closed when the scope ends, after the tuned code has run.
+ *
+ *   Impl::tuning_scope scope(latch_, answer_.data(), answer_.size());
+ *   body(answer_[0].value.int_value);
+ *
+ * Where the inputs or defaults cost something to compute, construct it
+ * from the latch alone and call request() only if !latched(). close()
+ * ends the context before the end of the scope, for work that shouldn't
+ * be timed with the tuned code. */
+class tuning_scope {
+public:
+  explicit tuning_scope(tuning_latch& latch) :
+    latch_(latch), latched_(latch.use_latched()) {}
+
+  tuning_scope(tuning_latch& latch, Kokkos::Tools::Experimental::VariableValue* answers,
+               const size_t count) : tuning_scope(latch) {
+    request(answers, count);
+  }
+
+  tuning_scope(const tuning_scope&) = delete;
+  tuning_scope& operator=(const tuning_scope&) = delete;
+
+  ~tuning_scope() { close(); }
+
+  // ask the tool for the answers, unless the latched ones are to be used
+  void request(Kokkos::Tools::Experimental::VariableValue* answers, const size_t count,
+               Kokkos::Tools::Experimental::VariableValue* inputs = nullptr,
+               const size_t num_inputs = 0) {
+    if (latched_ || open_) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(tuning_api_mutex());
+      context_ = Kokkos::Tools::Experimental::get_new_context_id();
+      Kokkos::Tools::Experimental::begin_context(context_);
+      if (num_inputs > 0) {
+        Kokkos::Tools::Experimental::set_input_values(context_, num_inputs, inputs);
+      }
+      Kokkos::Tools::Experimental::request_output_values(context_, count, answers);
+    }
+    open_ = true;
+    latch_.observe(answers, count);
+  }
+
+  void close() {
+    if (open_) {
+      open_ = false;
+      std::lock_guard<std::mutex> lock(tuning_api_mutex());
+      Kokkos::Tools::Experimental::end_context(context_);
+    }
+  }
+
+  // true if this scope reuses the latched answers and skips the tuning API
+  bool latched() const { return latched_; }
+
+private:
+  tuning_latch& latch_;
+  const bool latched_;
+  bool open_{false};
+  size_t context_{0};
+};
+
 } // namespace Impl
 
 template<typename Setup, typename Tunable>
@@ -51,24 +461,48 @@ void tuned_kernel(int argc, char* argv[], Setup setup, Tunable tunable){
     using emptiness =
         typename std::is_same<decltype(setup(num_iters)), void>::type;
     auto kernel_data = Impl::setup_helper(setup, num_iters, emptiness{});
-    Impl::invoke_benchmark(tunable, num_iters, kernel_data);
+    // name the benchmark after the program
+    std::string name{argv[0]};
+    Impl::benchmark bench(name.substr(name.find_last_of('/') + 1));
+    Impl::invoke_benchmark(bench, tunable, num_iters, kernel_data);
   }
   Kokkos::finalize();
 }
 
-void fastest_of_helper(int index){
-  /** error case*/
+namespace Impl {
+
+template<typename Result, size_t Index, typename Tuple>
+Result invoke_implementation(Tuple& implementations) {
+  return std::get<Index>(implementations)();
 }
 
-template<typename Head, typename... Cons>
-void fastest_of_helper(int index, Head head, Cons... cons){
-  if(index == 0){
-    return head();
+/* A constexpr table with one entry per implementation, so picking one is
+ * a single indexed call. The implementations can return values, as long
+ * as they have a common type. */
+template<typename Tuple, size_t... Indices>
+auto dispatch_implementation(const size_t index, Tuple& implementations,
+                             std::index_sequence<Indices...>) {
+  using result_type = std::common_type_t<
+      decltype(std::get<Indices>(implementations)())...>;
+  using function_type = result_type (*)(Tuple&);
+  static constexpr function_type table[] = {
+      &invoke_implementation<result_type, Indices, Tuple>...};
+  if (index >= sizeof...(Indices)) {
+    Kokkos::abort("fastest_of: implementation index out of range");
   }
-  return fastest_of_helper(index-1, cons...);
+  return table[index](implementations);
+}
+
+} // namespace Impl
+
+// run implementation number index, passing the implementations by reference
+template<typename... Implementations>
+auto fastest_of_helper(const size_t index, Implementations&... implementations){
+  auto references = std::forward_as_tuple(implementations...);
+  return Impl::dispatch_implementation(index, references,
+      std::index_sequence_for<Implementations...>{});
 }
 
-static std::unordered_map<std::string, size_t> ids_for_kernels;
 size_t create_categorical_int_tuner(std::string name, size_t num_options){
   using namespace Kokkos::Tools::Experimental;
   VariableInfo info;
@@ -85,49 +519,591 @@ size_t create_categorical_int_tuner(std::string name, size_t num_options){
 
 size_t create_fastest_implementation_id(const size_t count){
   using namespace Kokkos::Tools::Experimental;
-  static size_t id;
-  static bool done;
-  if(!done){
-    done = true;
+  // a function-local static is initialized exactly once, even when racing
+  static const size_t id = [](){
     VariableInfo info;
     info.category = StatisticalCategory::kokkos_value_categorical;
     info.type = ValueType::kokkos_value_int64;
     info.valueQuantity = CandidateValueType::kokkos_value_unbounded;
-    id = declare_input_type("playground.fastest_implementation_of", info);
-  }
+    return declare_input_type("playground.fastest_implementation_of", info);
+  }();
   return id;
 }
 
-template<typename ... Implementations>
-void fastest_of(const std::string& label, const size_t count, Implementations... implementations){
+/* Problem features for fastest_of. The values are bucketed before they
+ * reach the tuner - sizes and thread counts by log2 class - so that nearby
+ * problem sizes share a decision, while small and large problems are
+ * learned separately. */
+struct fastest_of_features {
+  int64_t size_class{0};
+  int64_t rank{0};
+  int64_t scalar_size{0};
+  int64_t thread_class{0};
+  // a nonzero key for the bucket, zero means "no features"
+  uint64_t key() const {
+    return 1 + (uint64_t(size_class) | (uint64_t(rank) << 8) |
+               (uint64_t(scalar_size) << 16) | (uint64_t(thread_class) << 32));
+  }
+};
+
+namespace Impl {
+
+inline int64_t log2_class(uint64_t value) {
+  int64_t size_class{0};
+  while (value >>= 1) {
+    size_class++;
+  }
+  return size_class;
+}
+
+// the input variables for the features, declared once
+inline const std::vector<size_t>& feature_variable_ids() {
+  using namespace Kokkos::Tools::Experimental;
+  static const std::vector<size_t> ids = [](){
+    VariableInfo info;
+    info.category = StatisticalCategory::kokkos_value_categorical;
+    info.type = ValueType::kokkos_value_int64;
+    info.valueQuantity = CandidateValueType::kokkos_value_unbounded;
+    std::lock_guard<std::mutex> lock(tuning_api_mutex());
+    return std::vector<size_t>{
+      declare_input_type("playground.size_class", info),
+      declare_input_type("playground.rank", info),
+      declare_input_type("playground.scalar_size", info),
+      declare_input_type("playground.thread_class", info)};
+  }();
+  return ids;
+}
+
+/* A bandit that picks an implementation by timing them itself, for when
+ * no tuning tool answers. Every implementation is first run
+ * PLAYGROUND_BANDIT_SAMPLES times (plus one untimed warm-up run). After
+ * that the fastest mean wins, except that PLAYGROUND_BANDIT_EXPLORE_PERCENT
+ * of the calls try another implementation, and every 16th call re-times
+ * the incumbent. Timings are fenced wall-clock times. */
+class bandit_tuner {
+public:
+  bandit_tuner() :
+    samples_(std::max<int64_t>(1, env_setting("PLAYGROUND_BANDIT_SAMPLES", 5))),
+    explore_percent_(env_setting("PLAYGROUND_BANDIT_EXPLORE_PERCENT", 5)) {}
+
+  // pick an implementation, and whether this call should be timed
+  size_t choose(const size_t count, bool& measure) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (counts_.empty()) {
+      counts_.assign(count, 0);
+      totals_.assign(count, 0.0);
+    }
+    measure = true;
+    // explore: everybody gets their samples first
+    const size_t fewest = std::min_element(counts_.begin(), counts_.end()) - counts_.begin();
+    if (counts_[fewest] <= samples_) {
+      return fewest;
+    }
+    // exploit, with the occasional random exploration
+    calls_++;
+    if (next_random() % 100 < uint64_t(explore_percent_)) {
+      return next_random() % count;
+    }
+    measure = (calls_ % 16 == 0);
+    return best_locked();
+  }
+
+  // record a timing, the first one for every implementation is a warm-up
+  void record(const size_t which, const double seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (counts_[which]++ > 0) {
+      totals_[which] += seconds;
+    }
+  }
+
+  // true until every implementation has its samples
+  bool exploring() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counts_.empty() ||
+        *std::min_element(counts_.begin(), counts_.end()) <= samples_;
+  }
+
+  // the fastest implementation so far, or -1 if nothing was measured
+  int64_t best() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return best_locked();
+  }
+
+  // a human readable summary of the measurements
+  std::string summary() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string result{"picked " + std::to_string(best_locked()) + ", mean seconds ["};
+    for (size_t i = 0 ; i < counts_.size() ; i++) {
+      result += (i > 0 ? ", " : "") + std::to_string(mean_locked(i)) +
+          " (" + std::to_string(std::max<int64_t>(0, counts_[i] - 1)) + " samples)";
+    }
+    return result + "]";
+  }
+
+private:
+  double mean_locked(const size_t which) const {
+    return counts_[which] > 1 ? totals_[which] / (counts_[which] - 1) : 0.0;
+  }
+  int64_t best_locked() const {
+    int64_t best{-1};
+    for (size_t i = 0 ; i < counts_.size() ; i++) {
+      if (counts_[i] > 1 && (best < 0 || mean_locked(i) < mean_locked(best))) {
+        best = i;
+      }
+    }
+    return best;
+  }
+  // xorshift, so that exploration is cheap and reproducible
+  uint64_t next_random() {
+    random_state_ ^= random_state_ << 13;
+    random_state_ ^= random_state_ >> 7;
+    random_state_ ^= random_state_ << 17;
+    return random_state_;
+  }
+  const int64_t samples_;
+  const int64_t explore_percent_;
+  std::mutex mutex_;
+  std::vector<int64_t> counts_;
+  std::vector<double> totals_;
+  uint64_t calls_{0};
+  uint64_t random_state_{0x9E3779B97F4A7C15ULL};
+};
+
+/* What fastest_of remembers per feature bucket */
+struct fastest_of_state {
+  // the features of the bucket, for reporting
+  fastest_of_features features;
+  // measures the implementations if we don't get a prediction
+  bandit_tuner bandit;
+  std::atomic<bool> used_bandit{false};
+  // the converged decision, valid while the latch is set
+  tuning_latch latch;
+  std::atomic<int64_t> decision{-1};
+};
+
+/* Closes a tuning context when it goes out of scope, i.e. after the
+ * implementation has run and produced its result. */
+struct context_guard {
+  size_t context_id;
+  ~context_guard() {
+    std::lock_guard<std::mutex> lock(tuning_api_mutex());
+    Kokkos::Tools::Experimental::end_context(context_id);
+  }
+};
+
+/* Times the implementation run in its scope with fences on both ends, and
+ * hands the time to the bandit. Does nothing without a bandit. */
+struct measurement_guard {
+  bandit_tuner* bandit;
+  size_t which;
+  Kokkos::Timer timer;
+  measurement_guard(bandit_tuner* bandit_, const size_t which_) :
+    bandit(bandit_), which(which_) {
+    if (bandit != nullptr) {
+      Kokkos::fence("fastest_of: before measurement");
+      timer.reset();
+    }
+  }
+  ~measurement_guard() {
+    if (bandit != nullptr) {
+      Kokkos::fence("fastest_of: after measurement");
+      bandit->record(which, timer.seconds());
+    }
+  }
+};
+
+/* Collects the choices of the built-in bandit, and prints them when
+ * Kokkos is finalized. Handles that are destroyed before that leave their
+ * summary behind; lines that come in after it, like those of static
+ * handles destroyed at exit, are printed right away. */
+class bandit_report {
+public:
+  static bandit_report& instance() {
+    static bandit_report report;
+    return report;
+  }
+  void add(const std::string& line) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Kokkos::is_finalized()) {
+      std::cout << line << std::endl;
+      return;
+    }
+    lines_.push_back(line);
+  }
+  // register a source of summary lines that is still alive at finalize
+  void attach(const void* owner, std::function<void()> report) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!hooked_) {
+      hooked_ = true;
+      Kokkos::push_finalize_hook([this]() { print(); });
+    }
+    live_.emplace_back(owner, std::move(report));
+  }
+  void detach(const void* owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    live_.erase(std::remove_if(live_.begin(), live_.end(),
+        [owner](const auto& entry) { return entry.first == owner; }), live_.end());
+  }
+
+private:
+  void print() {
+    std::vector<std::pair<const void*, std::function<void()>>> live;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      live = live_;
+    }
+    for (auto& entry : live) {
+      entry.second();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& line : lines_) {
+      std::cout << line << std::endl;
+    }
+    lines_.clear();
+  }
+  std::mutex mutex_;
+  bool hooked_{false};
+  std::vector<std::string> lines_;
+  std::vector<std::pair<const void*, std::function<void()>>> live_;
+};
+
+} // namespace Impl
+
+inline fastest_of_features make_features(const size_t elements, const size_t rank,
+    const size_t scalar_size, const size_t thread_count) {
+  fastest_of_features features;
+  features.size_class = Impl::log2_class(elements);
+  features.rank = rank;
+  features.scalar_size = scalar_size;
+  features.thread_class = Impl::log2_class(thread_count);
+  return features;
+}
+
+// the features of a View, for kernels that sweep over all of it
+template<typename ViewType>
+fastest_of_features features_of(const ViewType& view,
+    const size_t thread_count = Kokkos::DefaultExecutionSpace().concurrency()) {
+  return make_features(view.size(), ViewType::rank,
+      sizeof(typename ViewType::value_type), thread_count);
+}
+
+/* A handle for one fastest_of call site. Everything that only depends on
+ * the label and the number of implementations (the declared variable ids
+ * and the input/output values handed to the tuning API) is resolved once
+ * when the handle is constructed, so a call through the handle does no
+ * hashing, string work or variable declaration. A handle may be shared by
+ * any number of host threads. Keep it in a static at the call site:
+ *
+ *   static fastest_of_tuner tuner("choose_one", 3);
+ *   fastest_of(tuner, [&]() {...}, [&]() {...}, [&]() {...});
+ */
+class fastest_of_tuner {
+public:
+  fastest_of_tuner(const std::string& label, const size_t count) :
+    label_(label), count_(count) {
     using namespace Kokkos::Tools::Experimental;
-    auto tuner_iter = [&]() {
-      auto my_tuner = ids_for_kernels.find(label);
-      if (my_tuner == ids_for_kernels.end()) {
-        return (ids_for_kernels.emplace(label, create_categorical_int_tuner(label, sizeof...(Implementations)))
-                    .first);
+    std::lock_guard<std::mutex> lock(Impl::tuning_api_mutex());
+    const size_t var_id = create_categorical_int_tuner(label, count);
+    // the input identifies the call site, by its output variable
+    input_value_ = make_variable_value(create_fastest_implementation_id(count), int64_t(var_id));
+    output_value_ = make_variable_value(var_id, int64_t(-1));
+    Impl::bandit_report::instance().attach(this, [this]() { report(); });
+  }
+  ~fastest_of_tuner() {
+    Impl::bandit_report::instance().detach(this);
+    report();
+  }
+  const std::string& label() const { return label_; }
+  size_t count() const { return count_; }
+
+  /* The state for a feature bucket. Calls without features don't pay for
+   * the lookup. */
+  Impl::fastest_of_state& state_for(const fastest_of_features* features) {
+    if (features == nullptr) {
+      return default_state_;
+    }
+    std::lock_guard<std::mutex> lock(buckets_mutex_);
+    auto bucket = buckets_.try_emplace(features->key());
+    if (bucket.second) {
+      bucket.first->second.features = *features;
+    }
+    return bucket.first->second;
+  }
+
+  // hand the choices of the built-in bandit to the report
+  void report() {
+    const auto add = [this](Impl::fastest_of_state& state, const std::string& bucket) {
+      if (state.used_bandit.exchange(false)) {
+        Impl::bandit_report::instance().add("fastest_of(" + label_ + ")" + bucket +
+            ": " + state.bandit.summary());
       }
-      return my_tuner;
-    }();
-    auto var_id = tuner_iter->second;
-    auto input_id = create_fastest_implementation_id(count);
-    VariableValue picked_implementation = make_variable_value(var_id,int64_t(0));
-    VariableValue which_kernel = make_variable_value(var_id,label.c_str());
-    which_kernel.value.int_value = -1;
-    auto context_id = get_new_context_id();
-    begin_context(context_id);
-    set_input_values(context_id, 1, &picked_implementation);
-    request_output_values(context_id, 1, &which_kernel);
-    // if we didn't get a prediction, just alternate between methods.
+    };
+    add(default_state_, "");
+    std::lock_guard<std::mutex> lock(buckets_mutex_);
+    for (auto& bucket : buckets_) {
+      const fastest_of_features& features = bucket.second.features;
+      add(bucket.second, " [size_class=" + std::to_string(features.size_class) +
+          ", rank=" + std::to_string(features.rank) +
+          ", scalar_size=" + std::to_string(features.scalar_size) +
+          ", thread_class=" + std::to_string(features.thread_class) + "]");
+    }
+  }
+
+  /* Used by fastest_of: ask the tool which implementation to run (unless
+   * the decision is latched), run it, and close the context. Returns what
+   * the implementation returned. */
+  template<typename ... Implementations>
+  auto dispatch(Impl::fastest_of_state& state,
+                const Kokkos::Tools::Experimental::VariableValue* features,
+                const size_t num_features, Implementations&... implementations) {
+    using namespace Kokkos::Tools::Experimental;
+    // the tool and the bandit pick indices below count_
+    if (count_ != sizeof...(Implementations)) {
+      Kokkos::abort(("fastest_of(" + label_ + "): the tuner was made for " +
+          std::to_string(count_) + " implementations, but " +
+          std::to_string(sizeof...(Implementations)) + " were passed").c_str());
+    }
+    // converged? skip the tuning API and run the latched decision
+    if (state.latch.use_latched()) {
+      const int64_t which = state.decision.load(std::memory_order_relaxed);
+      Impl::log_dispatch(label_, which);
+      return fastest_of_helper(which, implementations...);
+    }
+    VariableValue inputs[5] = {input_value_};
+    for (size_t i = 0 ; i < num_features ; i++) {
+      inputs[i + 1] = features[i];
+    }
+    VariableValue which_kernel = output_value_;
+    size_t context_id;
+    {
+      std::lock_guard<std::mutex> lock(Impl::tuning_api_mutex());
+      context_id = get_new_context_id();
+      begin_context(context_id);
+      set_input_values(context_id, num_features + 1, inputs);
+      request_output_values(context_id, 1, &which_kernel);
+    }
+    // closes the context once the implementation has returned
+    Impl::context_guard context{context_id};
+    // if we didn't get a prediction, time the implementations ourselves
     if (which_kernel.value.int_value < 0) {
-        static int flipper{0};
-        fastest_of_helper(flipper, implementations...);
-        flipper = (flipper + 1) % count;
-    } else {
-        fastest_of_helper(which_kernel.value.int_value, implementations...);
+      state.used_bandit.store(true, std::memory_order_relaxed);
+      bool measure{false};
+      const size_t which = state.bandit.choose(count_, measure);
+      Impl::log_dispatch(label_, which);
+      Impl::measurement_guard measurement{measure ? &state.bandit : nullptr, which};
+      return fastest_of_helper(which, implementations...);
     }
-    end_context(context_id);
+    state.decision.store(which_kernel.value.int_value, std::memory_order_relaxed);
+    state.latch.observe(&which_kernel, 1);
+    Impl::log_dispatch(label_, which_kernel.value.int_value);
+    return fastest_of_helper(which_kernel.value.int_value, implementations...);
+  }
+
+private:
+  std::string label_;
+  size_t count_;
+  Kokkos::Tools::Experimental::VariableValue input_value_;
+  Kokkos::Tools::Experimental::VariableValue output_value_;
+  Impl::fastest_of_state default_state_;
+  std::mutex buckets_mutex_;
+  std::unordered_map<uint64_t, Impl::fastest_of_state> buckets_;
+};
+
+template<typename First, typename ... Implementations,
+         std::enable_if_t<!std::is_same<std::decay_t<First>, fastest_of_features>::value, int> = 0>
+auto fastest_of(fastest_of_tuner& tuner, First&& first, Implementations&&... implementations){
+    return tuner.dispatch(tuner.state_for(nullptr), nullptr, 0, first, implementations...);
 }
 
+/* Pick among the implementations for this particular problem. The tuner
+ * sees the bucketed features as inputs, and a separate decision is kept
+ * for every bucket. */
+template<typename ... Implementations>
+auto fastest_of(fastest_of_tuner& tuner, const fastest_of_features& features,
+                Implementations&&... implementations){
+    using namespace Kokkos::Tools::Experimental;
+    const auto& ids = Impl::feature_variable_ids();
+    VariableValue feature_values[4] = {
+        make_variable_value(ids[0], features.size_class),
+        make_variable_value(ids[1], features.rank),
+        make_variable_value(ids[2], features.scalar_size),
+        make_variable_value(ids[3], features.thread_class)};
+    return tuner.dispatch(tuner.state_for(&features), feature_values, 4, implementations...);
+}
+
+namespace Impl {
+
+/* The label -> handle map behind the label-based interface, split into
+ * shards so that threads using different labels rarely share a lock.
+ * Handles are never erased, so references to them stay valid. */
+constexpr const size_t num_tuner_shards{16};
+
+struct tuner_shard {
+  std::mutex mutex;
+  std::unordered_map<std::string, fastest_of_tuner> tuners;
+};
+
+inline fastest_of_tuner& find_tuner(const std::string& label, const size_t count) {
+  /* The tuners in the shards report to bandit_report when they are
+   * destroyed, so it has to be constructed before the shards, to be
+   * destroyed after them at exit. */
+  bandit_report::instance();
+  static tuner_shard shards[num_tuner_shards];
+  tuner_shard& shard = shards[std::hash<std::string>{}(label) % num_tuner_shards];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto tuner_iter = shard.tuners.find(label);
+  if (tuner_iter == shard.tuners.end()) {
+    tuner_iter = shard.tuners.emplace(std::piecewise_construct,
+        std::forward_as_tuple(label), std::forward_as_tuple(label, count)).first;
+  }
+  return tuner_iter->second;
+}
+
+} // namespace Impl
+
+#if defined(KOKKOS_ENABLE_OPENMP)
+namespace Impl {
+
+/* Partitioned OpenMP instances, created the first time a split is asked
+ * for and kept for the rest of the run. partition_space is expensive, and
+ * calling it inside a tuning loop adds its cost to exactly the kernel
+ * times the tuner compares. The instances are released when Kokkos is
+ * finalized, before the OpenMP backend goes away. */
+class openmp_instance_pool {
+public:
+  static openmp_instance_pool& instance() {
+    static openmp_instance_pool pool;
+    return pool;
+  }
+
+  // the instances from splitting the OpenMP pool by these weights
+  const std::vector<Kokkos::OpenMP>& partition(const std::vector<int>& weights) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto partition_iter = partitions_.find(weights);
+    if (partition_iter == partitions_.end()) {
+      if (!hooked_) {
+        hooked_ = true;
+        Kokkos::push_finalize_hook([this]() { clear(); });
+      }
+      partition_iter = partitions_.emplace(weights,
+          Kokkos::Experimental::partition_space(Kokkos::OpenMP(), weights)).first;
+    }
+    return partition_iter->second;
+  }
+
+  // an instance with num_threads of the threads, the others left idle
+  const Kokkos::OpenMP& with_threads(const int num_threads) {
+    const int leftover_threads = Kokkos::OpenMP().concurrency() - num_threads;
+    if (leftover_threads <= 0) {
+      return partition({1}).front();
+    }
+    return partition({num_threads, leftover_threads}).front();
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return partitions_.size();
+  }
+
+private:
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    partitions_.clear();
+    hooked_ = false;
+  }
+  std::mutex mutex_;
+  bool hooked_{false};
+  std::map<std::vector<int>, std::vector<Kokkos::OpenMP>> partitions_;
+};
+
+inline openmp_instance_pool& openmp_instances() {
+  return openmp_instance_pool::instance();
+}
+
+// an implementation for fastest_of_race, run on the whole pool and the real output
+template<typename Implementation, typename ViewType>
+auto bind_race(Implementation& implementation, const ViewType& output) {
+  return [&implementation, output]() {
+    return implementation(Kokkos::OpenMP(), output);
+  };
+}
+
+/* Run one racer on its instance, and scale its time by its share of the
+ * threads, so it is comparable to a run on the whole pool. */
+template<typename Implementation, typename ViewType>
+void race_one(Implementation& implementation, const Kokkos::OpenMP& instance,
+              const ViewType& output, const int total_threads, double& cost) {
+  instance.fence("fastest_of_race: before race");
+  Kokkos::Timer timer;
+  implementation(instance, output);
+  instance.fence("fastest_of_race: after race");
+  cost = timer.seconds() * instance.concurrency() / total_threads;
+}
+
+} // namespace Impl
+
+/* Racing mode for idempotent kernels that write all of their results to
+ * one View, such as out-of-place stencils or copies. Each implementation
+ * is called as implementation(instance, output), and must run on the
+ * given OpenMP instance and write only to the given output.
+ *
+ * While the built-in bandit is still exploring (no tuning tool answers),
+ * the OpenMP pool is split evenly (the split is pooled) and all the
+ * implementations run side by side, each into a private copy of the
+ * output, on their own host thread. Their times are normalized to their
+ * share of the threads and all go to the bandit at once, so it converges
+ * about count times sooner. The fastest racer's result is copied to the
+ * output. Otherwise this is an ordinary fastest_of on the whole pool. */
+template<typename ViewType, typename ... Implementations>
+void fastest_of_race(fastest_of_tuner& tuner, const ViewType& output,
+                     Implementations&&... implementations) {
+  constexpr size_t count = sizeof...(Implementations);
+  auto& state = tuner.state_for(nullptr);
+  const int total_threads = Kokkos::OpenMP().concurrency();
+  if (!state.used_bandit.load(std::memory_order_relaxed) ||
+      !state.bandit.exploring() || total_threads < int(count)) {
+    auto bound = std::make_tuple(Impl::bind_race(implementations, output)...);
+    std::apply([&](auto&... bound_implementations) {
+        tuner.dispatch(state, nullptr, 0, bound_implementations...);
+      }, bound);
+    return;
+  }
+  const auto& instances = Impl::openmp_instances().partition(std::vector<int>(count, 1));
+  // private outputs, with the pages touched before the race starts
+  std::vector<ViewType> outputs;
+  for (size_t i = 0 ; i < count ; i++) {
+    outputs.emplace_back(Kokkos::view_alloc(Kokkos::WithoutInitializing,
+        output.label() + " race"), output.layout());
+    Kokkos::deep_copy(outputs[i], output);
+  }
+  double costs[count];
+  std::vector<std::thread> racers;
+  const auto launch = [&](auto& implementation) {
+    const size_t i = racers.size();
+    racers.emplace_back([&, i]() {
+      Impl::race_one(implementation, instances[i], outputs[i], total_threads, costs[i]);
+    });
+  };
+  (launch(implementations), ...);
+  for (auto& racer : racers) {
+    racer.join();
+  }
+  for (size_t i = 0 ; i < count ; i++) {
+    state.bandit.record(i, costs[i]);
+  }
+  // they all computed the same thing, keep the fastest one's result
+  Kokkos::deep_copy(output, outputs[std::min_element(costs, costs + count) - costs]);
+}
+#endif
+
+/* Label-based interface, kept for convenience. Every call looks the label
+ * up in a map, so prefer a fastest_of_tuner handle in hot loops. As
+ * before the handles, the tuner is made for the implementations passed,
+ * whatever count says. */
+template<typename ... Implementations>
+auto fastest_of(const std::string& label, const size_t count, Implementations&&... implementations){
+    (void)count;
+    return fastest_of(Impl::find_tuner(label, sizeof...(Implementations)), implementations...);
+}
 
 #endif
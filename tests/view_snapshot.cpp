@@ -0,0 +1,126 @@
+/**
+ * view_snapshot
+ *
+ * Complexity: low
+ * Microbenchmark, not a tuning problem:
+ *
+ * Writes snapshots of Views of every supported rank, layout and value
+ * type, maps them back and checks that every cell survived the round
+ * trip. Snapshots of another rank, layout or value type, and truncated
+ * ones, have to be rejected.
+ *
+ * Then a 128^3 input is generated with fill_uniform and loaded from its
+ * snapshot, mapped and then copied into a View, and the two times are
+ * compared.
+ *
+ */
+#include <tuning_playground.hpp>
+#include <random_data.hpp>
+#include <view_snapshot.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+constexpr int length{128};
+constexpr int num_repeats{10};
+
+// true if a and b have the same extents and cells
+template<typename AType, typename BType>
+bool same_view(const AType& a, const BType& b) {
+    for (size_t d = 0 ; d < AType::rank ; d++) {
+        if (a.extent(d) != b.extent(d)) {
+            return false;
+        }
+    }
+    for (size_t i = 0 ; i < a.span() ; i++) {
+        if (a.data()[i] != b.data()[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// write a View filled with fill_uniform, map it back and compare
+template<typename ViewType, typename... Extents>
+bool round_trip(const std::string& path, Extents... extents) {
+    ViewType view("view", extents...);
+    fill_uniform(view, -1000, 1000);
+    if (!write_snapshot(path, view)) {
+        std::cout << "FAILED: could not write " << path << std::endl;
+        return false;
+    }
+    mapped_snapshot<ViewType> snapshot(path);
+    const bool passed = snapshot.valid() && same_view(view, snapshot.view());
+    std::cout << (passed ? "Round trip, rank " : "FAILED: round trip, rank ") << ViewType::rank
+              << ", " << sizeof(typename ViewType::value_type) << " byte values"
+              << (snapshot.valid() ? "" : ", " + snapshot.error()) << std::endl;
+    return passed;
+}
+
+// map a snapshot as the wrong type, which has to fail
+template<typename ViewType>
+bool rejected(const std::string& path, const std::string& what) {
+    mapped_snapshot<ViewType> snapshot(path);
+    std::cout << (snapshot.valid() ? "FAILED: accepted " : "Rejected ") << what
+              << (snapshot.valid() ? "" : ", " + snapshot.error()) << std::endl;
+    return !snapshot.valid();
+}
+
+// the best time of num_repeats calls, in milliseconds
+template<typename Iteration>
+double best_milliseconds(Iteration iteration) {
+    double best{0.0};
+    for (int i = 0 ; i < num_repeats ; i++) {
+        Kokkos::Timer timer;
+        iteration();
+        const double seconds = timer.seconds();
+        best = i == 0 ? seconds : std::min(best, seconds);
+    }
+    return best * 1.0e3;
+}
+
+int main(int argc, char *argv[]) {
+    bool passed = true;
+    const std::string path = "view_snapshot_" + std::to_string(getpid()) + ".snap";
+    Kokkos::initialize(argc, argv);
+    {
+        Kokkos::print_configuration(std::cout, false);
+        using right_3d = Kokkos::View<double ***, Kokkos::LayoutRight, Kokkos::HostSpace>;
+        using left_3d = Kokkos::View<double ***, Kokkos::LayoutLeft, Kokkos::HostSpace>;
+        passed &= round_trip<Kokkos::View<double *, Kokkos::HostSpace>>(path, 100003);
+        passed &= round_trip<Kokkos::View<float **, Kokkos::LayoutLeft, Kokkos::HostSpace>>(path, 97, 31);
+        passed &= round_trip<Kokkos::View<int **, Kokkos::LayoutRight, Kokkos::HostSpace>>(path, 31, 97);
+        passed &= round_trip<Kokkos::View<int64_t ****, Kokkos::HostSpace>>(path, 3, 5, 7, 11);
+        passed &= round_trip<left_3d>(path, 17, 19, 23);
+        passed &= round_trip<right_3d>(path, 17, 19, 23);
+
+        passed &= rejected<left_3d>(path, "the other layout");
+        passed &= rejected<Kokkos::View<float ***, Kokkos::HostSpace>>(path, "another value type");
+        passed &= rejected<Kokkos::View<double **, Kokkos::HostSpace>>(path, "another rank");
+        if (truncate(path.c_str(), Impl::snapshot_data_offset + 100) == 0) {
+            passed &= rejected<right_3d>(path, "a truncated snapshot");
+        }
+        passed &= rejected<right_3d>(path + ".missing", "a missing file");
+
+        /* Generating a 128^3 input, against mapping its snapshot */
+        right_3d input("input", length, length, length);
+        const double generated = best_milliseconds([&]() { fill_uniform(input, 100, 999); });
+        write_snapshot(path, input);
+        right_3d loaded("loaded", length, length, length);
+        const double mapped = best_milliseconds([&]() {
+            mapped_snapshot<right_3d> snapshot(path);
+            Kokkos::deep_copy(loaded, snapshot.view());
+        });
+        if (!same_view(input, loaded)) {
+            std::cout << "FAILED: the loaded input differs from the generated one" << std::endl;
+            passed = false;
+        }
+        std::cout << "128^3 input: generated in " << generated << " ms, loaded from a snapshot in "
+                  << mapped << " ms" << std::endl;
+    }
+    Kokkos::finalize();
+    std::remove(path.c_str());
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,255 @@
+#ifndef VIEWSNAPSHOT_HPP
+#define VIEWSNAPSHOT_HPP
+
+#include<tuning_playground.hpp>
+#include<cstdint>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<iostream>
+#include<string>
+#include<type_traits>
+#include<utility>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+/* A View snapshot is a file with a fixed 128 byte header, then the View's
+ * span in memory order, in the byte order of the machine that wrote it:
+ *
+ *   magic "KVSNAP\0\0", version, byte order mark, rank, layout, value type,
+ *   eight extents, zero padding
+ *
+ * The data start at a multiple of 128 bytes, so a snapshot can be mapped
+ * straight into an unmanaged View with mmap(2). */
+namespace Impl {
+
+constexpr const char snapshot_magic[8] = {'K', 'V', 'S', 'N', 'A', 'P', 0, 0};
+constexpr const uint32_t snapshot_version{1};
+constexpr const uint32_t snapshot_byte_order{0x01020304};
+constexpr const size_t snapshot_data_offset{128};
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t rank;
+    uint32_t layout;
+    uint32_t value_type;
+    uint32_t reserved;
+    uint64_t extents[8];
+};
+static_assert(sizeof(snapshot_header) <= snapshot_data_offset, "the snapshot header outgrew its space");
+
+enum snapshot_layout : uint32_t { snapshot_layout_right = 0, snapshot_layout_left = 1 };
+enum snapshot_value_type : uint32_t { snapshot_float = 1, snapshot_double = 2, snapshot_int32 = 3, snapshot_int64 = 4 };
+
+template<typename T> struct dependent_false : std::false_type {};
+
+template<typename Layout>
+constexpr uint32_t snapshot_layout_of() {
+    if constexpr (std::is_same<Layout, Kokkos::LayoutRight>::value) {
+        return snapshot_layout_right;
+    } else if constexpr (std::is_same<Layout, Kokkos::LayoutLeft>::value) {
+        return snapshot_layout_left;
+    } else {
+        static_assert(dependent_false<Layout>::value, "snapshots hold LayoutRight or LayoutLeft Views");
+        return 0;
+    }
+}
+
+template<typename T>
+constexpr uint32_t snapshot_value_type_of() {
+    if constexpr (std::is_same<T, float>::value) {
+        return snapshot_float;
+    } else if constexpr (std::is_same<T, double>::value) {
+        return snapshot_double;
+    } else if constexpr (std::is_integral<T>::value && sizeof(T) == 4) {
+        return snapshot_int32;
+    } else if constexpr (std::is_integral<T>::value && sizeof(T) == 8) {
+        return snapshot_int64;
+    } else {
+        static_assert(dependent_false<T>::value, "snapshots hold float, double, int32 or int64 values");
+        return 0;
+    }
+}
+
+// the directory of PLAYGROUND_SNAPSHOT_DIR, or empty if it is not set
+inline const std::string& snapshot_directory() {
+    static const std::string directory = [](){
+        const char* value{getenv("PLAYGROUND_SNAPSHOT_DIR")};
+        return std::string(value == nullptr ? "" : value);
+    }();
+    return directory;
+}
+
+} // namespace Impl
+
+/* Writes a snapshot of a View, copying it to the host first if it has to.
+ * Returns false if the file could not be written. */
+template<typename ViewType>
+bool write_snapshot(const std::string& path, const ViewType& view) {
+    using value_type = typename ViewType::non_const_value_type;
+    const auto host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), view);
+    if (!host.span_is_contiguous()) {
+        Kokkos::abort("write_snapshot needs a contiguous View");
+    }
+    Impl::snapshot_header header{};
+    std::memcpy(header.magic, Impl::snapshot_magic, sizeof(header.magic));
+    header.version = Impl::snapshot_version;
+    header.byte_order = Impl::snapshot_byte_order;
+    header.rank = ViewType::rank;
+    header.layout = Impl::snapshot_layout_of<typename ViewType::array_layout>();
+    header.value_type = Impl::snapshot_value_type_of<value_type>();
+    for (size_t d = 0 ; d < ViewType::rank ; d++) {
+        header.extents[d] = view.extent(d);
+    }
+    char block[Impl::snapshot_data_offset] = {};
+    std::memcpy(block, &header, sizeof(header));
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool written = std::fwrite(block, 1, sizeof(block), file) == sizeof(block);
+    written = written && std::fwrite(host.data(), sizeof(value_type), host.span(), file) == host.span();
+    return std::fclose(file) == 0 && written;
+}
+
+/* A snapshot mapped into memory, as an unmanaged host View of the same
+ * type as ViewType. Nothing is read until it is touched, and the mapping
+ * is private: writes to the View go to copy-on-write pages, never to the
+ * file. The View is valid while the mapped_snapshot lives. If the file is
+ * missing, truncated or holds another rank, layout or value type, valid()
+ * is false and error() says why. */
+template<typename ViewType>
+class mapped_snapshot {
+public:
+    using view_type = Kokkos::View<typename ViewType::non_const_data_type, typename ViewType::array_layout,
+                                   Kokkos::HostSpace, Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+
+    mapped_snapshot(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error_ = path + ": cannot open it";
+            return;
+        }
+        struct stat status;
+        if (fstat(fd, &status) == 0 && size_t(status.st_size) >= Impl::snapshot_data_offset) {
+            bytes_ = status.st_size;
+            void* base = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            base_ = base == MAP_FAILED ? nullptr : static_cast<char*>(base);
+        }
+        close(fd);
+        if (base_ == nullptr) {
+            error_ = path + ": not a snapshot, or cannot map it";
+            return;
+        }
+        error_ = check(path);
+        if (error_.empty()) {
+            view_ = make_view(std::make_index_sequence<ViewType::rank>());
+        }
+    }
+
+    mapped_snapshot(const mapped_snapshot&) = delete;
+    mapped_snapshot& operator=(const mapped_snapshot&) = delete;
+
+    ~mapped_snapshot() {
+        if (base_ != nullptr) {
+            munmap(base_, bytes_);
+        }
+    }
+
+    bool valid() const { return error_.empty(); }
+    const std::string& error() const { return error_; }
+    const view_type& view() const { return view_; }
+
+private:
+    std::string check(const std::string& path) const {
+        using value_type = typename ViewType::non_const_value_type;
+        Impl::snapshot_header header;
+        std::memcpy(&header, base_, sizeof(header));
+        if (std::memcmp(header.magic, Impl::snapshot_magic, sizeof(header.magic)) != 0 ||
+            header.version != Impl::snapshot_version) {
+            return path + ": not a snapshot, or of another version";
+        }
+        if (header.byte_order != Impl::snapshot_byte_order) {
+            return path + ": written with another byte order";
+        }
+        if (header.rank != ViewType::rank ||
+            header.value_type != Impl::snapshot_value_type_of<value_type>()) {
+            return path + ": holds another rank or value type";
+        }
+        // the two layouts are the same in rank 1
+        if (ViewType::rank > 1 && header.layout != Impl::snapshot_layout_of<typename ViewType::array_layout>()) {
+            return path + ": holds another layout";
+        }
+        uint64_t cells{1};
+        for (size_t d = 0 ; d < ViewType::rank ; d++) {
+            cells *= header.extents[d];
+        }
+        if (bytes_ < Impl::snapshot_data_offset + cells * sizeof(value_type)) {
+            return path + ": truncated";
+        }
+        return "";
+    }
+
+    template<size_t... D>
+    view_type make_view(std::index_sequence<D...>) const {
+        const auto* header = reinterpret_cast<const Impl::snapshot_header*>(base_);
+        return view_type(reinterpret_cast<typename view_type::pointer_type>(base_ + Impl::snapshot_data_offset),
+                         size_t(header->extents[D])...);
+    }
+
+    char* base_{nullptr};
+    size_t bytes_{0};
+    std::string error_;
+    view_type view_;
+};
+
+/* The input of a benchmark, kept between runs when PLAYGROUND_SNAPSHOT_DIR
+ * is set: view is loaded from <dir>/<name>.snap if that holds a View of
+ * the same type and extents, and otherwise filled with init() and saved
+ * there, for the next run. Without the setting, init() is just called. */
+template<typename ViewType, typename Init>
+void snapshot_input(const std::string& name, const ViewType& view, Init init) {
+    if (Impl::snapshot_directory().empty()) {
+        init();
+        return;
+    }
+    const std::string path = Impl::snapshot_directory() + "/" + name + ".snap";
+    {
+        mapped_snapshot<ViewType> snapshot(path);
+        bool same_extents = snapshot.valid();
+        for (size_t d = 0 ; same_extents && d < ViewType::rank ; d++) {
+            same_extents = snapshot.view().extent(d) == view.extent(d);
+        }
+        if (same_extents) {
+            std::cout << "Loading " << name << " from " << path << std::endl;
+            Kokkos::deep_copy(view, snapshot.view());
+            Kokkos::fence();
+            return;
+        }
+    }
+    init();
+    if (write_snapshot(path, view)) {
+        std::cout << "Saved " << name << " to " << path << std::endl;
+    } else {
+        std::cout << "Could not save " << name << " to " << path << std::endl;
+    }
+}
+
+/* The result of a benchmark, saved to <dir>/<name>.snap when
+ * PLAYGROUND_SNAPSHOT_DIR is set, to validate against later. */
+template<typename ViewType>
+void snapshot_output(const std::string& name, const ViewType& view) {
+    if (Impl::snapshot_directory().empty()) {
+        return;
+    }
+    const std::string path = Impl::snapshot_directory() + "/" + name + ".snap";
+    if (!write_snapshot(path, view)) {
+        std::cout << "Could not save " << name << " to " << path << std::endl;
+    }
+}
+
+#endif // VIEWSNAPSHOT_HPP